@@ -0,0 +1,236 @@
+/***************************************************************
+ * Name:      bench.cpp
+ * Purpose:   Times each phase of world::update on procedurally
+ *            generated ships, across thread counts, and writes
+ *            a CSV or JSON report
+ * Usage:     bench [-sizes 1000,10000,...] [-threads 1,2,4,...]
+ *                  [-mixes steel,wood,all] [-hull 0.25,...]
+ *                  [-holes 0.02,...] [-frames N] [-dt seconds]
+ *                  [-materials file.json] [-format csv|json]
+ *                  [-out file (default bench.csv/bench.json)]
+ *                  [-pin 0|1 (pin each worker to a CPU)]
+ **************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "material.h"
+#include "phys.h"
+#include "shipgen.h"
+#include "timer.h"
+#include "tinythread.h"
+#include "util.h"
+
+const int NPHASES = 5;
+const char *phaseNames[NPHASES] = {"build", "integrate", "springs", "breakage", "ships"};
+const char *precision = sizeof(real) == sizeof(double) ? "double" : "float";     // see vec.h; build with -DPHYS_DOUBLE for the reference
+
+struct result
+{
+    std::string mix;
+    int size;
+    float hullratio, holedensity;
+    int points, springs;
+    int threads;
+    double seconds[NPHASES];
+};
+
+std::string lowercase(std::string str)
+{
+    for (unsigned int i = 0; i < str.length(); i++)
+        str[i] = tolower(str[i]);
+    return str;
+}
+
+// A mix is every material whose name contains the mix name ("all" for everything),
+// split into hull and interior. Falls back to all materials of a kind if the mix has none.
+void selectMix(const std::vector<material*> &materials, std::string mix, shipgen::params &p)
+{
+    p.hull.clear();
+    p.interior.clear();
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (unsigned int i = 0; i < materials.size(); i++)
+        {
+            bool matches = pass == 1 || mix == "all" || lowercase(materials[i]->name).find(lowercase(mix)) != std::string::npos;
+            if (!matches)
+                continue;
+            if (materials[i]->isHull && (pass == 0 || p.hull.empty()))
+                p.hull.push_back(materials[i]);
+            else if (!materials[i]->isHull && (pass == 0 || p.interior.empty()))
+                p.interior.push_back(materials[i]);
+        }
+        if (pass == 0 && p.hull.size() && p.interior.size())
+            break;
+    }
+}
+
+result runOne(const std::vector<material*> &grid, int width, int height, int nthreads, bool pin, int nframes, double dt)
+{
+    result r;
+    for (int i = 0; i < NPHASES; i++)
+        r.seconds[i] = 0;
+    r.threads = nthreads;
+    phys::world wld(vec2(0, -9.8), 4, 0.01, nthreads, pin);
+    double start = timer::now();
+    phys::ship *shp = new phys::ship(&wld);
+    shp->build(grid, width, height);
+    r.seconds[0] = timer::now() - start;
+    r.points = wld.getNPoints();
+    r.springs = wld.getNSprings();
+    // Same steps as world::update, with a clock read between each
+    for (int frame = 0; frame < nframes; frame++)
+    {
+        wld.time += dt;
+        double t0 = timer::now();
+        wld.integratePoints(dt);
+        double t1 = timer::now();
+        wld.doSprings(dt);
+        double t2 = timer::now();
+        wld.removeBrokenSprings();
+        double t3 = timer::now();
+        wld.updateShips(dt);
+        double t4 = timer::now();
+        r.seconds[1] += t1 - t0;
+        r.seconds[2] += t2 - t1;
+        r.seconds[3] += t3 - t2;
+        r.seconds[4] += t4 - t3;
+    }
+    return r;
+}
+
+void writeReport(std::ostream &out, const std::vector<result> &results, std::string format, int nframes)
+{
+    if (format == "json")
+        out << "[\n";
+    else
+        out << "precision,mix,size,hullratio,holedensity,points,springs,threads,frames,phase,seconds,ms_per_frame,speedup,efficiency\n";
+    bool first = true;
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const result &r = results[i];
+        // Scaling is measured against the first thread count run for the same ship
+        const result *base = &r;
+        for (unsigned int j = 0; j < i; j++)
+            if (results[j].mix == r.mix && results[j].size == r.size && results[j].hullratio == r.hullratio && results[j].holedensity == r.holedensity)
+            {
+                base = &results[j];
+                break;
+            }
+        for (int phase = 0; phase < NPHASES; phase++)
+        {
+            double speedup = r.seconds[phase] > 0 ? base->seconds[phase] / r.seconds[phase] : 0;
+            double efficiency = speedup * base->threads / r.threads;
+            double perframe = phase == 0 ? r.seconds[phase] * 1000 : r.seconds[phase] * 1000 / nframes;
+            if (format == "json")
+            {
+                out << (first ? "" : ",\n") << "  {\"precision\": \"" << precision << "\", \"mix\": \"" << r.mix << "\", \"size\": " << r.size
+                    << ", \"hullratio\": " << r.hullratio << ", \"holedensity\": " << r.holedensity
+                    << ", \"points\": " << r.points << ", \"springs\": " << r.springs << ", \"threads\": " << r.threads
+                    << ", \"frames\": " << nframes << ", \"phase\": \"" << phaseNames[phase] << "\", \"seconds\": " << r.seconds[phase]
+                    << ", \"ms_per_frame\": " << perframe << ", \"speedup\": " << speedup << ", \"efficiency\": " << efficiency << "}";
+            }
+            else
+            {
+                out << precision << "," << r.mix << "," << r.size << "," << r.hullratio << "," << r.holedensity << "," << r.points << "," << r.springs
+                    << "," << r.threads << "," << nframes << "," << phaseNames[phase] << "," << r.seconds[phase]
+                    << "," << perframe << "," << speedup << "," << efficiency << "\n";
+            }
+            first = false;
+        }
+    }
+    if (format == "json")
+        out << "\n]\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string sizes = "1000,10000,100000,1000000", mixes = "steel,wood,all", hulls = "0.25", holes = "0.02";
+    std::string threads, materialfile = "data/materials.json", format = "csv", outfile;
+    int nframes = 20;
+    bool pin = false;
+    double dt = 0.02;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "-sizes")
+            sizes = value;
+        else if (arg == "-threads")
+            threads = value;
+        else if (arg == "-mixes")
+            mixes = value;
+        else if (arg == "-hull")
+            hulls = value;
+        else if (arg == "-holes")
+            holes = value;
+        else if (arg == "-frames")
+            nframes = atoi(value.c_str());
+        else if (arg == "-dt")
+            dt = atof(value.c_str());
+        else if (arg == "-materials")
+            materialfile = value;
+        else if (arg == "-format")
+            format = value;
+        else if (arg == "-out")
+            outfile = value;
+        else if (arg == "-pin")
+            pin = atoi(value.c_str()) != 0;
+        else
+            std::cout << "Ignoring unknown option " << arg << "\n";
+    }
+    if (threads.empty())
+    {
+        // Default: powers of two up to the core count, and the core count itself
+        int ncores = std::max(1, (int)tthread::thread::hardware_concurrency());
+        std::stringstream ss;
+        for (int n = 1; n < ncores; n *= 2)
+            ss << n << ",";
+        ss << ncores;
+        threads = ss.str();
+    }
+
+    std::cout << "Physics built in " << precision << " precision\n";
+    std::vector<material*> materials;
+    Json::Value matroot = jsonParseFile(materialfile);
+    for (unsigned int i = 0; i < matroot.size(); i++)
+        materials.push_back(new material(matroot[i]));
+
+    std::vector<std::string> sizelist = splitList(sizes), threadlist = splitList(threads), mixlist = splitList(mixes),
+                             hulllist = splitList(hulls), holelist = splitList(holes);
+    std::vector<result> results;
+    for (unsigned int s = 0; s < sizelist.size(); s++)
+    for (unsigned int m = 0; m < mixlist.size(); m++)
+    for (unsigned int h = 0; h < hulllist.size(); h++)
+    for (unsigned int o = 0; o < holelist.size(); o++)
+    {
+        shipgen::params p;
+        p.npoints = atoi(sizelist[s].c_str());
+        p.hullratio = atof(hulllist[h].c_str());
+        p.holedensity = atof(holelist[o].c_str());
+        selectMix(materials, mixlist[m], p);
+        int width, height;
+        std::vector<material*> grid = shipgen::generate(p, width, height);
+        for (unsigned int t = 0; t < threadlist.size(); t++)
+        {
+            result r = runOne(grid, width, height, atoi(threadlist[t].c_str()), pin, nframes, dt);
+            r.mix = mixlist[m];
+            r.size = p.npoints;
+            r.hullratio = p.hullratio;
+            r.holedensity = p.holedensity;
+            std::cout << r.mix << " " << r.size << " (" << r.points << " points, " << r.springs << " springs), "
+                      << r.threads << " threads: " << (r.seconds[1] + r.seconds[2] + r.seconds[3] + r.seconds[4]) * 1000 / nframes << " ms/frame\n";
+            results.push_back(r);
+        }
+    }
+
+    if (outfile.empty())
+        outfile = "bench." + format;
+    std::ofstream out(outfile.c_str());
+    writeReport(out, results, format, nframes);
+    std::cout << "Wrote " << results.size() << " runs to " << outfile << "\n";
+    return 0;
+}
@@ -3,22 +3,11 @@
 #include <IL/il.h>
 #include <IL/ilu.h>
 #include <iostream>
-#include <map>
 #include <string>
+#include "profiler.h"
 #include "util.h"
 
 
-const int directions[8][2] = {
-{ 1,  0},
-{ 1, -1},
-{ 0, -1},
-{-1, -1},
-{-1,  0},
-{-1,  1},
-{ 0,  1},
-{ 1,  1}
-};
-
 vec2 game::screen2world(vec2 pos)
 {
     float height = zoomsize * 2.0;
@@ -27,15 +16,58 @@ vec2 game::screen2world(vec2 pos)
                 (pos.y / canvasheight - 0.5) * -height + camy);
 }
 
-void game::loadShip(std::string filename)
+void game::loadShipAsync(std::string filename)
 {
-    lastFilename = filename;
+    if (staging)
+    {
+        std::cout << "Error: still loading \"" << stagingFilename << "\"\n";
+        return;
+    }
+    staging = new phys::world(vec2(0, -9.8), buoyancy, strength);
+    stagingFilename = filename;
+    {
+        tthread::lock_guard<tthread::mutex> guard(loadlock);
+        loaddone = false;
+        loadok = false;
+    }
+    setLoadProgress("queued", 0);
+    loader.schedule(new loadTask(this, staging, filename, colourtolerance, fleetsize));
+}
 
-    int nodecount = 0, springcount = 0;
+// Copies the world's saved state back over itself, which takes a few milliseconds even for big ships.
+// If there's nothing to go back to, falls back to loading the file again.
+void game::resetShip()
+{
+    if (isLoading())
+        return;
+    if (!wld->restorePristine() && lastFilename != "")
+        loadShipAsync(lastFilename);
+}
 
-    std::map<vec3f, material*> colourdict;
-    for (unsigned int i = 0; i < materials.size(); i++)
-        colourdict[materials[i]->colour] = materials[i];
+bool game::isLoading()
+{
+    return staging != 0;
+}
+
+float game::getLoadProgress(std::string &stage)
+{
+    tthread::lock_guard<tthread::mutex> guard(loadlock);
+    stage = loadstage;
+    return loadprogress;
+}
+
+void game::setLoadProgress(std::string stage, float progress)
+{
+    tthread::lock_guard<tthread::mutex> guard(loadlock);
+    loadstage = stage;
+    loadprogress = progress;
+}
+
+// Decoding and classifying are quick next to the build, so they only get the first third of the bar.
+bool game::buildShip(phys::world *target, std::string filename, int tolerance, int copies)
+{
+    setLoadProgress("decoding", 0);
+    palette colourdict(materials, tolerance);
 
     ILuint imghandle;
     ilGenImages(1, &imghandle);
@@ -47,6 +79,9 @@ void game::loadShip(std::string filename)
         std::cout << "Error: could not load image \"" << filename  << "\":";
         std::string errstr(iluErrorString(devilError));
         std::cout << devilError << ": " << errstr << "\n";
+        ilDeleteImage(imghandle);
+        setLoadProgress("failed", 1);
+        return false;
     }
 
     ILubyte *data = ilGetData();
@@ -55,72 +90,73 @@ void game::loadShip(std::string filename)
     width = ilGetInteger(IL_IMAGE_WIDTH);
     height = ilGetInteger(IL_IMAGE_HEIGHT);
 
-    phys::ship *shp = new phys::ship(wld);
-
-    std::map<int,  std::map <int, phys::point*> > points;
+    setLoadProgress("classifying", 0.2);
+    std::vector<material*> grid = colourdict.classifyImage(data, width, height);   // assume R G B
+    ilDeleteImage(imghandle);
 
-    for (int x = 0; x < width; x++)
+    // Build all the points and the beams between them (in parallel, one band of rows per worker)
+    setLoadProgress("building", 0.3);
+    int firstnode = target->getNPoints(), firstspring = target->getNSprings();
+    phys::ship *shp = new phys::ship(target);
+    shp->build(grid, width, height);
+    if (copies > 1)
     {
-        for (int y = 0; y < height; y++)
-        {
-            // assume R G B:
-            vec3f colour(data[(x + (height - y) * width) * 3 + 0] / 255.f,
-                         data[(x + (height - y) * width) * 3 + 1] / 255.f,
-                         data[(x + (height - y) * width) * 3 + 2] / 255.f);
-            if (colourdict.find(colour) != colourdict.end())
-            {
-                material *mtl = colourdict[colour];
-                points[x][y] = new phys::point(wld, vec2(x - width/2, y), mtl, mtl->isHull? 0 : 1);  // no buoyancy if it's a hull section
-                shp->points.insert(points[x][y]);
-                nodecount++;
-            }
-            else
-            {
-                points[x][y] = 0;
-            }
-        }
+        // The rest of the fleet is copied from the first, which is much quicker than building it again
+        setLoadProgress("instancing", 0.8);
+        phys::blueprint bp(shp);
+        target->spawn(bp, bp.convoy(copies - 1, 10));
     }
+    int nodecount = target->getNPoints() - firstnode, springcount = target->getNSprings() - firstspring;
+    target->savePristine();     // so resetShip() needn't do any of this again
+    setLoadProgress("done", 1);
+    std::cout << "Loaded ship \"" << filename << "\": " << nodecount << " points, " << springcount << " springs.\n";
+    return true;
+}
+
+game::loadTask::loadTask(game *_gm, phys::world *_target, std::string _filename, int _tolerance, int _copies)
+{
+    gm = _gm;
+    target = _target;
+    filename = _filename;
+    tolerance = _tolerance;
+    copies = _copies;
+}
 
-    // Points have been generated, so fill in all the beams between them.
-    // If beam joins two hull nodes, it is a hull beam.
-    // If a non-hull node has empty space on one of its four sides, it is automatically leaking.
+void game::loadTask::process()
+{
+    bool ok = gm->buildShip(target, filename, tolerance, copies);
+    tthread::lock_guard<tthread::mutex> guard(gm->loadlock);
+    gm->loadok = ok;
+    gm->loaddone = true;
+}
+
+const char *game::loadTask::getName()
+{
+    return "load ship";
+}
 
-    for (int x = 0; x < width; x++)
+// Only called between frames, when no step has the world, so the old one can go straight away.
+// A load that failed leaves the current world as it was.
+void game::swapLoadedShip()
+{
+    if (!staging)
+        return;
     {
-        for (int y = 0; y < height; y++)
-        {
-            phys::point *a = points[x][y];
-            if (!a)
-                continue;
-            // First four directions out of 8: from 0 deg (+x) through to 135 deg (-x +y) - this covers each pair of points in each direction
-            for (int i = 0; i < 4; i++)
-            {
-                phys::point *b = points[x + directions[i][0]][y + directions[i][1]];                        // adjacent point in direction (i)
-                phys::point *c = points[x + directions[(i + 1) % 8][0]][y + directions[(i + 1) % 8][1]];    // adjacent point in next CW direction (for constructing triangles)
-                if (b)
-                {
-                    bool pointIsHull = a->mtl->isHull;
-                    bool isHull = pointIsHull && b->mtl->isHull;
-                    material *mtl = b->mtl->isHull? a->mtl : b->mtl;    // the spring is hull iff both nodes are hull; if so we use the hull material.
-                    shp->springs.insert(new phys::spring(wld, a, b, mtl, -1));
-                    if (!isHull)
-                    {
-                        shp->adjacentnodes[a].insert(b);
-                        shp->adjacentnodes[b].insert(a);
-                    }
-                    if (!(pointIsHull || (points[x+1][y] && points[x][y+1] && points[x-1][y] && points[x][y-1])))   // check for gaps next to non-hull areas:
-                    {
-                        a->isLeaking = true;
-                    }
-                    if (c)
-                        shp->triangles.insert(new phys::ship::triangle(shp, a, b, c));
-                    springcount++;
-                }
-            }
-        }
+        tthread::lock_guard<tthread::mutex> guard(loadlock);
+        if (!loaddone)
+            return;
     }
-    ilDeleteImage(imghandle);
-    std::cout << "Loaded ship \"" << filename << "\": " << nodecount << " points, " << springcount << " springs.\n";
+    loader.wait();      // (already finished; this just collects the task)
+    if (loadok)
+    {
+        delete wld;
+        wld = staging;
+        lastFilename = stagingFilename;
+        assertSettings();
+    }
+    else
+        delete staging;
+    staging = 0;
 }
 
 void game::loadDepth(std::string filename)
@@ -145,20 +181,50 @@ void game::assertSettings()
     wld->waveheight = waveheight;
     wld->seadepth = seadepth;
     wld->showstress = showstress;
+    wld->stressmap = stressmap;
     wld->quickwaterfix = quickwaterfix;
     wld->oceandepthbuffer = oceandepthbuffer;
     wld->xraymode = xraymode;
+    wld->immediatemode = immediatemode;
 }
 
-void game::update()
+game::stepTask::stepTask(game *_gm, bool _tooldown, vec2 _toolpos, phys::AABB _view)
+{
+    gm = _gm;
+    tooldown = _tooldown;
+    toolpos = _toolpos;
+    view = _view;
+}
+
+void game::stepTask::process()
+{
+    gm->step(tooldown, toolpos);
+    gm->wld->capture(gm->snapshots[1 - gm->front], view);
+}
+
+const char *game::stepTask::getName()
+{
+    return "step";
+}
+
+void game::step(bool tooldown, vec2 toolpos)
 {
-    if (mouse.ldown)
+    if (tooldown)
     {
         if (tool == TOOL_SMASH)
-            wld->destroyAt(screen2world(vec2(mouse.x, mouse.y)));
+            wld->destroyAt(toolpos);
         else if (tool == TOOL_GRAB)
-            wld->drawTo(screen2world(vec2(mouse.x, mouse.y)));
+            wld->drawTo(toolpos);
     }
+    if (running)
+        wld->update(0.02);
+}
+
+void game::update()
+{
+    PROFILE_SCOPE("update");
+    // The tool position is fixed now, against the camera the user is looking through
+    vec2 toolpos = screen2world(vec2(mouse.x, mouse.y));
     if (mouse.rdown)
     {
         vec2 difference = screen2world(vec2(mouse.x, mouse.y)) - screen2world(vec2(mouse.lastx, mouse.lasty));
@@ -167,18 +233,49 @@ void game::update()
     }
     mouse.lastx = mouse.x;
     mouse.lasty = mouse.y;
-    if (running)
-        wld->update(0.02);
+    if (pipelined && !immediatemode)
+    {
+        // The world belongs to the pipeline thread until finishUpdate(); we only draw the front snapshot.
+        // That snapshot is drawn next frame, by when the view may have panned or zoomed out a notch, so capture a bit extra.
+        pipeline.schedule(new stepTask(this, mouse.ldown, toolpos, visibleArea(1.25f)));
+        stepping = true;
+    }
+    else
+        step(mouse.ldown, toolpos);
 }
 
-void game::render()
+// The handoff: once the step is done its snapshot becomes the front one, and the old front is free to
+// be refilled. Only the pipeline thread touches the back snapshot and only this one the front, so
+// neither needs a lock - the scheduler's wait() is the only synchronisation.
+void game::finishUpdate()
+{
+    if (stepping)
+    {
+        pipeline.wait();
+        front = 1 - front;
+        stepping = false;
+    }
+    swapLoadedShip();
+}
+
+phys::AABB game::visibleArea(float scale)
 {
-    float halfheight = zoomsize;
+    float halfheight = zoomsize * scale;
     float halfwidth = (float)canvaswidth / canvasheight * halfheight;
-    wld->render(camx - halfwidth, camx + halfwidth, camy - halfheight, camx + halfheight);
+    return phys::AABB(vec2(camx - halfwidth, camy - halfheight), vec2(camx + halfwidth, camy + halfheight));
+}
+
+void game::render()
+{
+    PROFILE_SCOPE("render");
+    phys::AABB view = visibleArea();
+    if (pipelined && !immediatemode)
+        wld->render(view.bottomleft.x, view.topright.x, view.bottomleft.y, view.topright.y, &snapshots[front]);
+    else
+        wld->render(view.bottomleft.x, view.topright.x, view.bottomleft.y, view.topright.y);
 }
 
-game::game()
+game::game(): pipeline(1), loader(1)
 {
     Json::Value matroot = jsonParseFile("data/materials.json");
     for (unsigned int i = 0; i < matroot.size(); i++)
@@ -190,9 +287,20 @@ game::game()
     waveheight = 1.0;
     waterpressure = 0.3;
     seadepth = 150;
+    colourtolerance = 0;
+    fleetsize = 1;
     showstress = false;
+    stressmap = false;
     quickwaterfix = false;
     xraymode = false;
+    immediatemode = false;
+    pipelined = true;
+    front = 0;
+    stepping = false;
+    staging = 0;
+    loaddone = false;
+    loadok = false;
+    loadprogress = 0;
     zoomsize = 30.f;
     camx = 0;
     camy = 0;
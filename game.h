@@ -8,6 +8,23 @@
 class game
 {
     std::vector <material*> materials;
+    struct stepTask;
+    scheduler pipeline;             // one thread, which runs the steps when pipelined
+    phys::snapshot snapshots[2];    // the one being drawn, and the one the next step is filling
+    int front;                      // index of the one being drawn
+    bool stepping;                  // a step has been handed to the pipeline and not yet collected
+    void step(bool tooldown, vec2 toolpos);
+    struct loadTask;
+    scheduler loader;               // one thread, which builds ships in the background (and so is the only one to use DevIL, which keeps one bound image for everyone)
+    phys::world *staging;           // the world a background load is building, until finishUpdate swaps it in
+    std::string stagingFilename;
+    tthread::mutex loadlock;        // guards the four below, which the loader writes as it goes
+    bool loaddone, loadok;
+    float loadprogress;
+    std::string loadstage;
+    void setLoadProgress(std::string stage, float progress);
+    bool buildShip(phys::world *target, std::string filename, int tolerance, int copies);
+    void swapLoadedShip();
 public:
 
     struct
@@ -28,19 +45,28 @@ public:
     double waveheight;
     double waterpressure;
     double seadepth;
+    int colourtolerance;    // max per-channel difference (0-255) for a pixel to count as a material's colour
+    int fleetsize;          // copies of each ship loaded, the first built from the image and the rest instanced from it
     bool showstress;
+    bool stressmap;
     bool quickwaterfix;
     bool xraymode;
+    bool immediatemode;
+    bool pipelined;         // simulate the next step while drawing this one (needs the batched renderer)
 
     bool running;
 
     float zoomsize;
     float camx, camy;
     int canvaswidth, canvasheight;
-    void loadShip(std::string filename);
+    void loadShipAsync(std::string filename);   // builds a new world in the background, which replaces this one once it's ready
+    bool isLoading();
+    void resetShip();       // back to how the world was just after the last load; only between finishUpdate() and the next update(), when no step has the world
+    float getLoadProgress(std::string &stage);  // 0-1, and what the loader is doing
     void loadDepth(std::string filename);
     void assertSettings();
     vec2 screen2world(vec2);
+    phys::AABB visibleArea(float scale = 1);   // scale > 1 pads the view out about its centre
 
     std::string lastFilename;
     float *oceandepthbuffer;
@@ -48,7 +74,32 @@ public:
     phys::world *wld;
     game();
     void render();
-    void update();
+    void update();          // when pipelined, this only starts the step...
+    void finishUpdate();    // ...and this waits for it, after the frame has been drawn (and swaps in a loaded ship)
+};
+
+// One simulation step with the current tool applied, then a snapshot of the result for the next frame
+struct game::stepTask: scheduler::task
+{
+    stepTask(game *_gm, bool _tooldown, vec2 _toolpos, phys::AABB _view);
+    game *gm;
+    bool tooldown;
+    vec2 toolpos;
+    phys::AABB view;        // what to capture
+    virtual void process();
+    virtual const char *getName();
+};
+
+// Decode and build a ship into a world of its own, which nothing else touches until the load is done
+struct game::loadTask: scheduler::task
+{
+    loadTask(game *_gm, phys::world *_target, std::string _filename, int _tolerance, int _copies);
+    game *gm;
+    phys::world *target;
+    std::string filename;
+    int tolerance, copies;  // colourtolerance and fleetsize as they were when the load was asked for
+    virtual void process();
+    virtual const char *getName();
 };
 
 
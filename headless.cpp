@@ -0,0 +1,277 @@
+/***************************************************************
+ * Name:      headless.cpp
+ * Purpose:   Runs the simulation without a window, for timing the
+ *            physics on machines with no display
+ * Usage:     headless [ship.png] [-frames N] [-dt seconds]
+ *                     [-materials file.json] [-script events.txt]
+ *                     [-trace trace.json] [-threads N] [-pin]
+ *                     [-fleet N (copies of the ship, instanced)]
+ *                     [-checkfleet (compare an instance with a built ship, then exit)]
+ **************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <IL/il.h>
+#include "material.h"
+#include "phys.h"
+#include "profiler.h"
+#include "timer.h"
+#include "util.h"
+
+// A scripted use of a tool, in world coordinates. Script lines look like
+//     <frame> smash <x> <y>
+//     <frame> grab <x> <y> [<frames>]
+//     <frame> reset        (back to the ship as loaded)
+// and anything after a '#' is ignored.
+struct scriptEvent
+{
+    int frame;
+    enum {SMASH, GRAB, RESET} tool;
+    vec2 pos;
+    bool operator<(const scriptEvent &rhs) const {return frame < rhs.frame;}
+};
+
+std::vector<scriptEvent> loadScript(std::string filename)
+{
+    std::vector<scriptEvent> events;
+    std::ifstream file(filename.c_str());
+    if (!file.is_open())
+    {
+        std::cout << "Error: could not open script \"" << filename << "\"\n";
+        return events;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::stringstream ss(line.substr(0, line.find('#')));
+        scriptEvent event;
+        std::string tool;
+        int duration = 1;
+        if (!(ss >> event.frame >> tool))
+            continue;
+        if (tool == "reset")
+        {
+            event.tool = scriptEvent::RESET;
+            events.push_back(event);
+            continue;
+        }
+        if (!(ss >> event.pos.x >> event.pos.y))
+            continue;
+        event.tool = tool == "grab" ? scriptEvent::GRAB : scriptEvent::SMASH;
+        if (event.tool == scriptEvent::GRAB)
+            ss >> duration;     // (the grab tool only pulls while the mouse is held, so hold it for a number of frames)
+        for (int i = 0; i < duration; i++, event.frame++)
+            events.push_back(event);
+    }
+    std::stable_sort(events.begin(), events.end());
+    return events;
+}
+
+bool loadGrid(const palette &colours, std::string filename, std::vector<material*> &grid, int &width, int &height)
+{
+    ILuint imghandle;
+    ilGenImages(1, &imghandle);
+    ilBindImage(imghandle);
+    if (!ilLoadImage((const ILstring)(filename.c_str())))
+    {
+        std::cout << "Error: could not load image \"" << filename << "\": " << ilGetError() << "\n";
+        ilDeleteImage(imghandle);
+        return false;
+    }
+    width = ilGetInteger(IL_IMAGE_WIDTH);
+    height = ilGetInteger(IL_IMAGE_HEIGHT);
+    grid = colours.classifyImage(ilGetData(), width, height);
+    ilDeleteImage(imghandle);
+    return true;
+}
+
+void loadShip(phys::world *wld, const std::vector<material*> &grid, int width, int height, int copies)
+{
+    phys::ship *shp = new phys::ship(wld);
+    shp->build(grid, width, height);
+    if (copies > 1)
+    {
+        phys::blueprint bp(shp);
+        wld->spawn(bp, bp.convoy(copies - 1, 10));
+    }
+}
+
+// An instance has to be the same ship as the one it was copied from, openings and all, not just the
+// same shape. So build one world from the image and instance another from a blueprint, in the same
+// place, and run them side by side: they should leak alike and take on the same water.
+bool checkFleet(const std::vector<material*> &grid, int width, int height, int nthreads, int nframes, double dt)
+{
+    phys::world built(vec2(0, -9.8), 4, 0.01, nthreads), source(vec2(0, -9.8), 4, 0.01, nthreads), instanced(vec2(0, -9.8), 4, 0.01, nthreads);
+    loadShip(&built, grid, width, height, 1);
+    phys::ship *shp = new phys::ship(&source);
+    shp->build(grid, width, height);
+    phys::blueprint bp(shp);
+    instanced.spawn(bp, std::vector<phys::placement>(1, phys::placement()));
+    for (int frame = 0; frame < nframes; frame++)
+    {
+        built.update(dt);
+        instanced.update(dt);
+    }
+    phys::world *worlds[2] = {&built, &instanced};
+    const char *names[2] = {"built", "instanced"};
+    for (int i = 0; i < 2; i++)
+        std::cout << "  " << names[i] << ": " << worlds[i]->getNPoints() << " points, " << worlds[i]->getNSprings()
+                  << " springs, " << worlds[i]->getNLeaking() << " leaking, " << worlds[i]->getTotalWater() << " water\n";
+    // (The water only has to agree to within rounding, in case the two are ever laid out differently)
+    double water = built.getTotalWater();
+    bool ok = built.getNPoints() == instanced.getNPoints() && built.getNSprings() == instanced.getNSprings() &&
+              built.getNLeaking() == instanced.getNLeaking() && std::fabs(instanced.getTotalWater() - water) <= 0.01 * water + 1e-6;
+    if (!ok)
+        std::cout << "Error: the instanced ship doesn't behave like the built one\n";
+    return ok;
+}
+
+// Busy time against blocked time per worker: low utilisation with long barriers means the
+// frame is stuck in synchronisation (or the chunks are unbalanced), not short of compute.
+void printSchedulerStats(const scheduler::stats &stats, double elapsed)
+{
+    std::cout << "Scheduler (" << stats.threads.size() << " workers):\n";
+    double working = 0;
+    for (unsigned int i = 0; i < stats.threads.size(); i++)
+    {
+        const scheduler::stats::threadStats &t = stats.threads[i];
+        working += t.working;
+        std::cout << "  worker " << i << ": " << t.tasks << " tasks, " << t.working * 100 / elapsed << "% working, "
+                  << t.waiting * 100 / elapsed << "% waiting, " << t.locked * 1000 << " ms holding the queue lock\n";
+    }
+    std::cout << "  utilisation " << working * 100 / (elapsed * stats.threads.size()) << "%, "
+              << stats.barriers << " barriers, mean " << (stats.barriers ? stats.barrierTime / stats.barriers * 1e6 : 0)
+              << " us, max " << stats.maxBarrier * 1e6 << " us, queue high-water " << stats.maxQueueDepth
+              << ", " << stats.scheduleLocked * 1000 << " ms holding the queue lock in schedule()\n";
+}
+
+// Bytes per object, all in: each object's own storage and its share of the lists that refer to it.
+void printMemoryStats(const phys::world::memoryStats &m)
+{
+    std::cout << "Memory: " << (m.points + m.springs + m.triangles + m.water) / 1024 << " KB\n";
+    std::cout << "  points:    " << m.points / 1024 << " KB, " << (m.npoints ? m.points / m.npoints : 0) << " bytes each\n";
+    std::cout << "  springs:   " << m.springs / 1024 << " KB, " << (m.nsprings ? m.springs / m.nsprings : 0) << " bytes each\n";
+    std::cout << "  triangles: " << m.triangles / 1024 << " KB, " << (m.ntriangles ? m.triangles / m.ntriangles : 0) << " bytes each\n";
+    std::cout << "  water flow adjacency: " << m.water / 1024 << " KB, " << (m.npoints ? m.water / m.npoints : 0) << " bytes per point\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string shipfile = "ship.png", materialfile = "data/materials.json", scriptfile, tracefile;
+    int nframes = 1000, nthreads = 0, copies = 1;
+    bool pin = false, checkfleet = false;
+    double dt = 0.02;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-frames" && i + 1 < argc)
+            nframes = atoi(argv[++i]);
+        else if (arg == "-dt" && i + 1 < argc)
+            dt = atof(argv[++i]);
+        else if (arg == "-materials" && i + 1 < argc)
+            materialfile = argv[++i];
+        else if (arg == "-script" && i + 1 < argc)
+            scriptfile = argv[++i];
+        else if (arg == "-trace" && i + 1 < argc)
+            tracefile = argv[++i];
+        else if (arg == "-threads" && i + 1 < argc)
+            nthreads = atoi(argv[++i]);
+        else if (arg == "-pin")
+            pin = true;
+        else if (arg == "-fleet" && i + 1 < argc)
+            copies = atoi(argv[++i]);
+        else if (arg == "-checkfleet")
+            checkfleet = true;
+        else
+            shipfile = arg;
+    }
+
+    ilInit();
+    std::vector<material*> materials;
+    Json::Value matroot = jsonParseFile(materialfile);
+    for (unsigned int i = 0; i < matroot.size(); i++)
+        materials.push_back(new material(matroot[i]));
+    std::vector<scriptEvent> events;
+    if (!scriptfile.empty())
+        events = loadScript(scriptfile);
+    double loadstart = timer::now();     // (the image, then the ship)
+    std::vector<material*> grid;
+    int width, height;
+    if (!loadGrid(palette(materials), shipfile, grid, width, height))
+        return 1;
+    if (checkfleet)
+    {
+        std::cout << "Checking an instance of \"" << shipfile << "\" against a built copy over " << nframes << " steps:\n";
+        return checkFleet(grid, width, height, nthreads, nframes, dt) ? 0 : 1;
+    }
+
+    phys::world wld(vec2(0, -9.8), 4, 0.01, nthreads, pin);
+    if (pin)
+    {
+        std::cout << "Workers pinned to CPUs";
+        for (int i = 0; i < wld.getScheduler().getNThreads(); i++)
+            std::cout << " " << wld.getScheduler().getCPU(i);
+        std::cout << "\n";
+    }
+    if (!tracefile.empty())
+        wld.getScheduler().setTracing(true);
+    loadShip(&wld, grid, width, height, copies);
+    std::cout << "Loaded ship \"" << shipfile << "\" in " << timer::now() - loadstart << " s: "
+              << wld.getNPoints() << " points, " << wld.getNSprings() << " springs.\n";
+    printMemoryStats(wld.getMemoryStats());
+    for (unsigned int i = 0; i < events.size(); i++)
+        if (events[i].tool == scriptEvent::RESET)
+        {
+            wld.savePristine();
+            break;
+        }
+
+    // Count the work actually done each step, since smashing and breakage shrink the ship as it goes
+    double pointsteps = 0, springsteps = 0;
+    wld.getScheduler().resetStats();
+    unsigned int nextevent = 0;
+    double start = timer::now();
+    for (int frame = 0; frame < nframes; frame++)
+    {
+        for (; nextevent < events.size() && events[nextevent].frame <= frame; nextevent++)
+        {
+            if (events[nextevent].tool == scriptEvent::GRAB)
+                wld.drawTo(events[nextevent].pos);
+            else if (events[nextevent].tool == scriptEvent::SMASH)
+                wld.destroyAt(events[nextevent].pos);
+            else
+            {
+                double resetstart = timer::now();
+                wld.restorePristine();
+                std::cout << "Reset at frame " << frame << " in " << (timer::now() - resetstart) * 1000 << " ms\n";
+            }
+        }
+        pointsteps += wld.getNPoints();
+        springsteps += wld.getNSprings();
+        wld.update(dt);
+#ifdef PROFILING
+        profiler::endFrame();
+#endif
+    }
+    double elapsed = timer::now() - start;
+
+    std::cout << "Simulated " << nframes << " steps of " << dt << " s in " << elapsed << " s\n";
+    std::cout << "  " << nframes / elapsed << " steps/s\n";
+    std::cout << "  " << springsteps / elapsed << " springs/s\n";
+    std::cout << "  " << pointsteps / elapsed << " points/s\n";
+    std::cout << "Final state: " << wld.getNPoints() << " points, " << wld.getNSprings() << " springs.\n";
+    printSchedulerStats(wld.getScheduler().getStats(), elapsed);
+    if (!tracefile.empty() && wld.getScheduler().writeTrace(tracefile))
+        std::cout << "Wrote scheduler trace to " << tracefile << "\n";
+#ifdef PROFILING
+    if (profiler::writeCSV("profile.csv"))
+        std::cout << "Wrote per-phase timings to profile.csv\n";
+#endif
+    return 0;
+}
@@ -13,6 +13,8 @@
 #include <IL/il.h>
 #include <IL/ilu.h>
 #include "game.h"
+#include "profiler.h"
+#include "render.h"
 #include "util.h"
 #include <sstream>
 
@@ -70,10 +72,7 @@ void endgl(GLFWwindow *window, game *gm)
     if (dlgOpen->ShowModal() == wxID_OK)
     {
         std::string filename = dlgOpen->GetPath().ToStdString();
-        delete gm.wld;
-        gm.wld = new phys::world;
-        gm.assertSettings();
-        gm.loadShip(filename);
+        gm.loadShipAsync(filename);
     }
 }*/
 
@@ -91,14 +90,23 @@ void endgl(GLFWwindow *window, game *gm)
 
 void titanicFrame::OnMenuReloadSelected(wxCommandEvent& event)
 {
-        delete gm.wld;
-        gm.wld = new phys::world;
-        gm.assertSettings();
-        gm.loadShip(gm.lastFilename);
+        gm.resetShip();
 }*/
 
 void doInput(GLFWwindow *window, game &gm)
 {
+    // Ctrl+R puts the ship back as it was loaded, at once. R reads it in from the file again, in the
+    // background; the old one keeps sinking until the new one is ready.
+    static bool reloaddown = false;
+    bool reload = glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS;
+    if (reload && !reloaddown)
+    {
+        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS)
+            gm.resetShip();
+        else if (!gm.isLoading() && gm.lastFilename != "")
+            gm.loadShipAsync(gm.lastFilename);
+    }
+    reloaddown = reload;
 
     double xd, yd;
     glfwGetCursorPos(window, &xd, &yd);
@@ -142,7 +150,7 @@ int main()
     glfwMakeContextCurrent(window);
 
     game gm;
-    gm.loadShip("ship.png");
+    gm.loadShipAsync("ship.png");       // the window opens straight away, on an empty sea
 
     bool running = true;
     while (running && !glfwWindowShouldClose(window))
@@ -151,16 +159,33 @@ int main()
         if (glfwGetTime() - lasttime > 1.0)
         {
             lasttime = glfwGetTime();
-            glfwSetWindowTitle(window, ("Sinking Simulator - " + gm.lastFilename +  " (" + tostring<int>(nframes) + " FPS)").c_str());
+            std::string title = "Sinking Simulator - " + gm.lastFilename +  " (" + tostring<int>(nframes) + " FPS)";
+            if (gm.isLoading())
+            {
+                std::string stage;
+                float progress = gm.getLoadProgress(stage);
+                title += " - " + stage + " (" + tostring<int>(progress * 100) + "%)";
+            }
+            glfwSetWindowTitle(window, title.c_str());
             nframes = 0;
         }
         doInput(window, gm);
         gm.update();
         initgl(window, &gm);
         gm.render();
+#ifdef PROFILING
+        render::profileOverlay(gm.canvaswidth, gm.canvasheight);
+#endif
         endgl(window, &gm);
+        gm.finishUpdate();
+#ifdef PROFILING
+        profiler::endFrame();   // after the step, so its sections are done being written
+#endif
         glfwPollEvents();
     }
+#ifdef PROFILING
+    profiler::writeCSV("profile.csv");
+#endif
     glfwTerminate();
     return 0;
 }
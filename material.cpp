@@ -1,5 +1,7 @@
 #include "material.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <sstream>
 
 
@@ -29,6 +31,107 @@ material::material(Json::Value root)
     mass = root.get("mass", 1).asDouble();
     strength = root.get("strength", 1).asDouble() / mass * 1000;
     colour = hex2Colour((root.isMember("colour") ? root["colour"] : root["color"]).asString());  // may as well account for American spelling...
+    rgb = ((unsigned int)(colour.x * 255.f + 0.5f) << 16) | ((unsigned int)(colour.y * 255.f + 0.5f) << 8) | (unsigned int)(colour.z * 255.f + 0.5f);
     isHull = root["isHull"].asBool();
     std::cout << "Adding new material: \"" << name << "\" " << colour.toString() << "\n";
 }
+
+// PPPP        A     L        EEEEEEE  TTTTTTT  TTTTTTT  EEEEEEE
+// P   PP     A A    L        E           T        T     E
+// P    PP   A   A   L        E           T        T     E
+// P   PP   A     A  L        E           T        T     E
+// PPPP     AAAAAAA  L        EEEE        T        T     EEEE
+// P        A     A  L        E           T        T     E
+// P        A     A  L        E           T        T     E
+// P        A     A  L        E           T        T     E
+// P        A     A  LLLLLLL  EEEEEEE     T        T     EEEEEEE
+
+const unsigned int EMPTY_SLOT = 0xFFFFFFFF;     // can never be a 24-bit colour
+const int MIN_SHIFT = 20;                       // caps the table at 4096 slots
+
+unsigned int palette::slot(unsigned int rgb) const
+{
+    return (rgb * 2654435761U) >> shift;        // Knuth's multiplicative hash: top bits of the product
+}
+
+palette::palette(const std::vector<material*> &_materials, int _tolerance)
+{
+    materials = _materials;
+    tolerance = _tolerance;
+    // Start with a table at least twice the size of the palette and keep doubling until nothing collides.
+    // If it still collides at the size cap, the odd colour just probes on to the next free slot.
+    for (shift = 31; (1U << (32 - shift)) < 2 * materials.size(); shift--);
+    while (true)
+    {
+        keys.assign(1U << (32 - shift), EMPTY_SLOT);
+        values.assign(1U << (32 - shift), (material*)0);
+        bool collision = false;
+        for (unsigned int i = 0; i < materials.size(); i++)
+        {
+            unsigned int s = slot(materials[i]->rgb);
+            while (keys[s] != EMPTY_SLOT && keys[s] != materials[i]->rgb)   // (a duplicate colour isn't a collision - the later material wins)
+            {
+                collision = true;
+                s = (s + 1) & (keys.size() - 1);
+            }
+            keys[s] = materials[i]->rgb;
+            values[s] = materials[i];
+        }
+        if (!collision || shift <= MIN_SHIFT)
+            break;
+        shift--;
+    }
+}
+
+material *palette::nearest(unsigned int rgb) const
+{
+    material *best = 0;
+    int bestdistance = tolerance + 1;
+    for (unsigned int i = 0; i < materials.size(); i++)
+    {
+        unsigned int other = materials[i]->rgb;
+        int distance = abs((int)(rgb >> 16) - (int)(other >> 16));
+        distance = std::max(distance, abs((int)((rgb >> 8) & 0xFF) - (int)((other >> 8) & 0xFF)));
+        distance = std::max(distance, abs((int)(rgb & 0xFF) - (int)(other & 0xFF)));
+        if (distance < bestdistance)
+        {
+            best = materials[i];
+            bestdistance = distance;
+        }
+    }
+    return best;
+}
+
+material *palette::lookup(unsigned int rgb) const
+{
+    for (unsigned int s = slot(rgb); keys[s] != EMPTY_SLOT; s = (s + 1) & (keys.size() - 1))
+        if (keys[s] == rgb)
+            return values[s];
+    return tolerance > 0 ? nearest(rgb) : 0;
+}
+
+void palette::classifyRow(const unsigned char *pixels, int count, material **out) const
+{
+    // Ship images are mostly long runs of the same colour, so only look up a pixel when it differs from the last one
+    unsigned int last = EMPTY_SLOT;
+    material *lastmtl = 0;
+    for (int i = 0; i < count; i++)
+    {
+        unsigned int rgb = (pixels[i * 3] << 16) | (pixels[i * 3 + 1] << 8) | pixels[i * 3 + 2];
+        if (rgb != last)
+        {
+            last = rgb;
+            lastmtl = lookup(rgb);
+        }
+        out[i] = lastmtl;
+    }
+}
+
+std::vector<material*> palette::classifyImage(const unsigned char *data, int width, int height) const
+{
+    // Ship row y comes from image row (height - y), so row 0 lies just past the end of the image and stays empty.
+    std::vector<material*> grid(width * height, (material*)0);
+    for (int y = 1; y < height; y++)
+        classifyRow(data + (height - y) * width * 3, width, &grid[y * width]);
+    return grid;
+}
@@ -3,6 +3,7 @@
 
 #include <json/json.h>
 #include <string>
+#include <vector>
 #include "vec.h"
 
 
@@ -12,8 +13,29 @@ struct material
     float strength;
     float mass;
     vec3f colour;
+    unsigned int rgb;   // colour packed as 0xRRGGBB, for exact matching against image pixels
     bool isHull;
     material(Json::Value);
 };
 
+// Maps packed 24-bit colours onto materials.
+// The table is sized so every material colour hashes to its own slot (a perfect hash), so an exact
+// lookup is one multiply and one compare. With a nonzero tolerance, colours that miss fall back to
+// the nearest material whose channels are all within tolerance of the pixel's.
+class palette
+{
+    std::vector<unsigned int> keys;
+    std::vector<material*> values;
+    std::vector<material*> materials;
+    int shift;
+    int tolerance;
+    unsigned int slot(unsigned int rgb) const;
+    material *nearest(unsigned int rgb) const;
+public:
+    palette(const std::vector<material*> &_materials, int _tolerance = 0);
+    material *lookup(unsigned int rgb) const;
+    void classifyRow(const unsigned char *pixels, int count, material **out) const;   // pixels are packed R G B bytes
+    std::vector<material*> classifyImage(const unsigned char *data, int width, int height) const;  // result is indexed [x + y * width], y up
+};
+
 #endif // _MATERIAL_H_
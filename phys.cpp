@@ -2,9 +2,8 @@
 
 #include <algorithm>
 #include <cmath>
-#include <GL/gl.h>
 #include <iostream>
-#include "render.h"
+#include "profiler.h"
 
 // W     W    OOO    RRRR     L        DDDD
 // W     W   O   O   R   RR   L        D  DDD
@@ -26,44 +25,170 @@ int imax(int a, int b)
     return a > b ? a : b;
 }
 
-void phys::world::update(double dt)
+void phys::world::update(real dt)
 {
     time += dt;
     // Advance simulation for points: (velocity and forces)
-    for (unsigned int i = 0; i < points.size(); i++)
-        points[i]->update(dt);
+    integratePoints(dt);
     // Iterate the spring relaxation (can tune this parameter, or make it scale automatically depending on free time)
     doSprings(dt);
     // Check if any springs exceed their breaking strain:
-    for (std::vector<spring*>::iterator iter = springs.begin(); iter != springs.end();)
+    removeBrokenSprings();
+    // Tell each ship to update all of its water stuff
+    updateShips(dt);
+    // Colours only change with water, so work them out once here rather than at every vertex that's drawn
+    updateColours();
+}
+
+// The phases of update(), exposed separately so they can be timed individually:
+
+void phys::world::integratePoints(real dt)
+{
+    PROFILE_SCOPE("integrate");
+    real drag = 1 - std::pow((real)0.6, dt);
+    for (int i = 0; i < nhull; i++)
+        points[i]->update<false>(dt, drag);
+    for (unsigned int i = nhull; i < points.size(); i++)
+        points[i]->update<true>(dt, drag);
+}
+
+bool phys::world::isHull(point *p)
+{
+    return p->buoyancy == 0;
+}
+
+// New points go on the end of the list; move the hull ones down into the hull range.
+// (Both ranges keep the order they were built in, so neighbouring points stay close in memory.)
+void phys::world::addPoints(int first)
+{
+    // Before the rotate, which moves some of the old buoyant points into [first, end)
+    for (unsigned int i = first; i < points.size(); i++)
+        if (points[i]->isLeaking)
+            leaking.push_back(points[i]);
+    std::vector<point*>::iterator newhull = std::stable_partition(points.begin() + first, points.end(), isHull);
+    int count = newhull - (points.begin() + first);
+    std::rotate(points.begin() + nhull, points.begin() + first, newhull);
+    nhull += count;
+}
+
+void phys::world::removeBrokenSprings()
+{
+    PROFILE_SCOPE("breakage");
+    // Reads the strains left by the last damping pass; deleting a spring erases it (and its strain) from the lists
+    for (unsigned int i = 0; i < springs.size();)
     {
-        spring *spr = *iter;
-        iter++;
-        if (spr->isBroken())        // have to delete after erasure - else there is a possibility of
-            delete spr;             // other objects accessing a bad pointer during this cleanup
+        if (springs[i]->isBroken(strains[i]))
+            delete springs[i];
+        else
+            i++;
     }
-    // Tell each ship to update all of its water stuff
+}
+
+void phys::world::updateShips(real dt)
+{
+    leakWater(dt);
     for (unsigned int i = 0; i < ships.size(); i++)
         ships[i]->update(dt);
 }
 
-void phys::world::doSprings(double dt)
+void phys::world::updateColours()
 {
-    int nchunks = springScheduler.getNThreads();
-    int springchunk = springs.size() / nchunks + 1;
+    PROFILE_SCOPE("colours");
+    for (unsigned int i = 0; i < points.size(); i++)
+        points[i]->colour = points[i]->getColour(materials[points[i]->mtlid]->colour);
+}
+
+// Cut the ship into vertical slabs with about the same number of points each, one per worker, and sort
+// the springs by slab. A slab's interior springs only touch its own points, so all the interiors can
+// be relaxed at once, each by one worker on a compact set of points. A spring with its ends in
+// neighbouring slabs belongs to the seam between them; seams are done every other one at a time, so
+// no two running at once share a slab. Which slab a point is in is decided from its position here
+// and then fixed until the next partition, so moving points can't break any of this, only make it
+// less local. Springs keep their build order within each range.
+void phys::world::partitionSprings()
+{
+    const int MIN_SLAB_SPRINGS = 256;   // below this a slab isn't worth a task of its own
+    int nslabs = imax(imin(springScheduler.getNThreads(), springs.size() / MIN_SLAB_SPRINGS), 1);
+    std::vector<real> splits;           // slab s is x in [splits[s - 1], splits[s])
+    if (nslabs > 1)
+    {
+        std::vector<real> xs(points.size());
+        for (unsigned int i = 0; i < points.size(); i++)
+            xs[i] = points[i]->pos.x;
+        for (int s = 1; s < nslabs; s++)
+        {
+            std::vector<real>::iterator split = xs.begin() + xs.size() * s / nslabs;
+            std::nth_element(splits.empty() ? xs.begin() : xs.begin() + xs.size() * (s - 1) / nslabs, split, xs.end());
+            splits.push_back(*split);
+        }
+    }
+    // Counting sort into ranges: interiors, then seams, then the rest
+    int nranges = 2 * nslabs;
+    std::vector<int> range(springs.size());
+    slabranges.assign(nranges + 1, 0);
+    for (unsigned int i = 0; i < springs.size(); i++)
+    {
+        int sa = std::upper_bound(splits.begin(), splits.end(), springs[i]->a->pos.x) - splits.begin();
+        int sb = std::upper_bound(splits.begin(), splits.end(), springs[i]->b->pos.x) - splits.begin();
+        if (sa == sb)
+            range[i] = sa;
+        else if (sa - sb == 1 || sb - sa == 1)
+            range[i] = nslabs + imin(sa, sb);
+        else
+            range[i] = nranges - 1;
+        slabranges[range[i] + 1]++;
+    }
+    for (int r = 0; r < nranges; r++)
+        slabranges[r + 1] += slabranges[r];
+    std::vector<spring*> sorted(springs.size());
+    std::vector<real> sortedstrains(springs.size());
+    std::vector<int> next(slabranges.begin(), slabranges.end() - 1);
+    for (unsigned int i = 0; i < springs.size(); i++)
+    {
+        sorted[next[range[i]]] = springs[i];
+        sortedstrains[next[range[i]]++] = strains[i];
+    }
+    springs.swap(sorted);
+    strains.swap(sortedstrains);
+    partitioned = true;
+}
+
+void phys::world::relaxRange(int first, int last, int worker)
+{
+    if (first < last)
+        springScheduler.schedule(new springCalculateTask(this, first, last - 1), worker);
+}
+
+void phys::world::doSprings(real dt)
+{
+    if (!partitioned)
+        partitionSprings();
+    int nslabs = slabranges.size() / 2;
     for (int outiter = 0; outiter < 3; outiter++)
     {
-        for (int iteration = 0; iteration < 8; iteration++)
         {
-            for (int i = springs.size() - 1; i > 0; i -= springchunk)
+            PROFILE_SCOPE("springs: relax");
+            // Seams first: whatever is relaxed last ends each pass closest to its rest length, and that
+            // should be the bulk of the ship (seams last left the stock ship noticeably weaker).
+            for (int iteration = 0; iteration < 8; iteration++)
             {
-                springScheduler.schedule(new springCalculateTask(this, imax(i - springchunk, 0), i));
+                for (int parity = 0; parity < 2 && nslabs > 1; parity++)
+                {
+                    for (int s = nslabs + parity; s < 2 * nslabs - 1; s += 2)
+                        relaxRange(slabranges[s], slabranges[s + 1], s - nslabs);   // (the worker that has the slab on the left)
+                    springScheduler.wait();
+                }
+                for (int i = slabranges[2 * nslabs - 1]; i < slabranges[2 * nslabs]; i++)    // (only ever on slabs thinner than a spring)
+                    springs[i]->update();
+                for (int s = 0; s < nslabs; s++)
+                    relaxRange(slabranges[s], slabranges[s + 1], s);
+                springScheduler.wait();
             }
-            springScheduler.wait();
         }
-        float dampingamount = (1 - pow(0.0, dt)) * 0.5;
-        for (unsigned int i = 0; i < springs.size(); i++)
-            springs[i]->damping(dampingamount);
+        PROFILE_SCOPE("springs: damping");
+        real dampingamount = (1 - std::pow((real)0, dt)) * (real)0.5;
+        for (unsigned int i = 0; i < springs.size(); i++)      // damping doesn't move the points, so the last pass's strains are final
+            strains[i] = springs[i]->damping(dampingamount);
     }
 }
 
@@ -79,7 +204,12 @@ void phys::world::springCalculateTask::process()
         wld->springs[i]->update();
 }
 
-phys::world::pointIntegrateTask::pointIntegrateTask(world *_wld, int _first, int _last, float _dt)
+const char *phys::world::springCalculateTask::getName()
+{
+    return "springs";
+}
+
+phys::world::pointIntegrateTask::pointIntegrateTask(world *_wld, int _first, int _last, real _dt)
 {
     wld = _wld;
     first = _first;
@@ -96,30 +226,9 @@ void phys::world::pointIntegrateTask::process()
 
 }
 
-void phys::world::render(double left, double right, double bottom, double top)
+const char *phys::world::pointIntegrateTask::getName()
 {
-    // Draw the ocean floor
-    renderLand(left, right, bottom, top);
-    if (quickwaterfix)
-        renderWater(left, right, bottom, top);
-    // Draw all the points and springs
-    for (unsigned int i = 0; i < points.size(); i++)
-        points[i]->render();
-    for (unsigned int i = 0; i < springs.size(); i++)
-        springs[i]->render();
-    if (!xraymode)
-        for (unsigned int i = 0; i < ships.size(); i++)
-            ships[i]->render();
-    if (showstress)
-        for (unsigned int i = 0; i < springs.size(); i++)
-            if (springs[i]->isStressed())
-                springs[i]->render(true);
-    if (!quickwaterfix)
-        renderWater(left, right, bottom, top);
-    glBegin(GL_LINES);
-    glLineWidth(1.f);
-    glEnd();
-    //buildBVHTree(true, points, collisionTree);
+    return "integrate";
 }
 
 void swapf(float &x, float &y)
@@ -148,7 +257,6 @@ void phys::world::buildBVHTree(bool splitInX, std::vector<point*> &pointlist, BV
     for (unsigned int i = 1; i < npoints; i++)
         thisnode->volume.extendTo(pointlist[i]->getAABB());
 
-    thisnode->volume.render();
     if (npoints <= BVHNode::MAX_N_POINTS || depth >= BVHNode::MAX_DEPTH)
     {
         thisnode->isLeaf = true;
@@ -177,54 +285,29 @@ void phys::world::buildBVHTree(bool splitInX, std::vector<point*> &pointlist, BV
     }
 }
 
-void phys::world::renderLand(double left, double right, double bottom, double top)
-{
-    glColor4f(0.5, 0.5, 0.5, 1);
-    double slicewidth = (right - left) / 200.0;
-    for (double slicex = left; slicex < right; slicex += slicewidth)
-    {
-        glBegin(GL_TRIANGLE_STRIP);
-        glVertex3f(slicex, oceanfloorheight(slicex), -1);
-        glVertex3f(slicex + slicewidth, oceanfloorheight(slicex + slicewidth), -1);
-        glVertex3f(slicex, bottom, -1);
-        glVertex3f(slicex + slicewidth, bottom, -1);
-        glEnd();
-    }
-}
-
-void phys::world::renderWater(double left, double right, double bottom, double top)
-{
-    // Cut the water into vertical slices (to get the different heights of waves) and draw it
-    glColor4f(0, 0.25, 1, 0.5);
-    double slicewidth = (right - left) / 100.0;
-    for (double slicex = left; slicex < right; slicex += slicewidth)
-    {
-        glBegin(GL_TRIANGLE_STRIP);
-        glVertex3f(slicex, waterheight(slicex), -1);
-        glVertex3f(slicex + slicewidth, waterheight(slicex + slicewidth), -1);
-        glVertex3f(slicex, bottom, -1);
-        glVertex3f(slicex + slicewidth, bottom, -1);
-        glEnd();
-    }
-}
-
-float phys::world::oceanfloorheight(float x)
+real phys::world::oceanfloorheight(real x)
 {
     /*x += 1024.f;
     x = x - 2048.f * floorf(x / 2048.f);
     float t = x - floorf(x);
     return oceandepthbuffer[(int)floorf(x)] * (1 - t) + oceandepthbuffer[((int)ceilf(x)) % 2048] * t;*/
-    return (sinf(x * 0.005f) * 10.f + sinf(x * 0.015f) * 6.f - sin(x * 0.0011f) * 45.f) - seadepth;
+    return (std::sin(x * 0.005f) * 10.f + std::sin(x * 0.015f) * 6.f - std::sin(x * 0.0011f) * 45.f) - seadepth;
 }
 
 // Function of time and x (though time is constant during the update step, so no need to parameterise it)
-float phys::world::waterheight(float x)
+real phys::world::waterheight(real x)
 {
-    return (sinf(x * 0.1f + time) * 0.5f + sinf(x * 0.3f - time * 1.1f) * 0.3f) * waveheight;
+    return waterheight(x, time);
+}
+
+// ...except when drawing a snapshot, which may be a step behind the simulation
+real phys::world::waterheight(real x, real t)
+{
+    return (std::sin(x * 0.1f + t) * 0.5f + std::sin(x * 0.3f - t * 1.1f) * 0.3f) * waveheight;
 }
 
 // Destroy all points within a 0.5m radius (could parameterise the radius but...)
-void phys::world::destroyAt(vec2f pos)
+void phys::world::destroyAt(vec2 pos)
 {
     for (std::vector<point*>::iterator iter = points.begin(); iter != points.end();)
     {
@@ -239,19 +322,183 @@ void phys::world::destroyAt(vec2f pos)
 }
 
 // Attract all points to a single position
-void phys::world::drawTo(vec2f target)
+void phys::world::drawTo(vec2 target)
 {
     for (std::vector<point*>::iterator iter = points.begin(); iter != points.end(); iter++)
     {
-        vec2f &pos = (*iter)->pos;
-        vec2f dir = (target - pos);
-        double magnitude = 50000 / sqrt(0.1 + dir.length());
-        (*iter)->applyForce(dir.normalise() * magnitude);
+        vec2 &pos = (*iter)->pos;
+        vec2 dir = (target - pos);
+        real magnitude = 50000 / std::sqrt((real)0.1 + dir.length());
+        (*iter)->applyForce(dir.normaliseApprox() * magnitude);
     }
 }
 
+int phys::world::getNPoints()
+{
+    return points.size();
+}
+
+int phys::world::getNSprings()
+{
+    return springs.size();
+}
+
+int phys::world::getNLeaking()
+{
+    return leaking.size();
+}
+
+double phys::world::getTotalWater()
+{
+    double total = 0;
+    for (unsigned int i = 0; i < points.size(); i++)
+        total += points[i]->water;
+    return total;
+}
+
+float phys::world::getSubmergedFraction()
+{
+    if (points.empty())
+        return 0;
+    int submerged = 0;
+    for (unsigned int i = 0; i < points.size(); i++)
+        if (points[i]->pos.y < waterheight(points[i]->pos.x))
+            submerged++;
+    return (float)submerged / points.size();
+}
+
+scheduler &phys::world::getScheduler()
+{
+    return springScheduler;
+}
+
+unsigned short phys::world::materialIndex(material *mtl)
+{
+    for (unsigned int i = 0; i < materials.size(); i++)
+        if (materials[i] == mtl)
+            return i;
+    materials.push_back(mtl);
+    return materials.size() - 1;
+}
+
+phys::world::memoryStats phys::world::getMemoryStats()
+{
+    const size_t TREE_NODE = 4 * sizeof(void*);     // colour and three links per node, as in libstdc++'s and MSVC's trees
+    memoryStats m;
+    m.npoints = points.size();
+    m.nsprings = springs.size();
+    m.ntriangles = 0;
+    m.points = pointPool.getNBytes() + (points.capacity() + leaking.capacity()) * sizeof(point*) + materials.capacity() * sizeof(material*);
+    m.springs = springPool.getNBytes() + springs.capacity() * sizeof(spring*) + strains.capacity() * sizeof(real);
+    m.triangles = 0;
+    m.water = 0;
+    for (unsigned int i = 0; i < ships.size(); i++)
+    {
+        m.ntriangles += ships[i]->triangles.size();
+        m.triangles += ships[i]->triangles.capacity() * sizeof(ship::triangle);
+        for (std::map<point*, std::set<point*> >::iterator iter = ships[i]->adjacentnodes.begin(); iter != ships[i]->adjacentnodes.end(); iter++)
+            m.water += TREE_NODE + sizeof(*iter) + iter->second.size() * (TREE_NODE + sizeof(point*));
+    }
+    return m;
+}
+
+void phys::world::savePristine()
+{
+    if (!pristine)
+        pristine = new pristineCopy;
+    pointPool.save(pristine->pointSlots);
+    springPool.save(pristine->springSlots);
+    pristine->points = points;
+    pristine->leaking = leaking;
+    pristine->springs = springs;
+    pristine->strains = strains;
+    pristine->slabranges = slabranges;
+    pristine->nhull = nhull;
+    pristine->partitioned = partitioned;
+    pristine->time = time;
+    pristine->triangles.resize(ships.size());
+    for (unsigned int i = 0; i < ships.size(); i++)
+    {
+        pristine->triangles[i] = ships[i]->triangles;
+        ships[i]->severed.clear();
+    }
+}
+
+// The pools come back byte for byte, and the lists are copied into storage that's already big enough,
+// as they never shrink, so none of that allocates. The adjacency maps are put right by re-inserting
+// just the entries broken springs took out, which costs a set node each: that's proportional to the
+// damage done since the save, not to the size of the ship.
+bool phys::world::restorePristine()
+{
+    if (!pristine || pristine->triangles.size() != ships.size())
+        return false;
+    if (!pointPool.restore(pristine->pointSlots) || !springPool.restore(pristine->springSlots))
+        return false;
+    points = pristine->points;
+    leaking = pristine->leaking;
+    springs = pristine->springs;
+    strains = pristine->strains;
+    slabranges = pristine->slabranges;
+    nhull = pristine->nhull;
+    partitioned = pristine->partitioned;
+    time = pristine->time;
+    for (unsigned int i = 0; i < ships.size(); i++)
+    {
+        ship *shp = ships[i];
+        shp->triangles = pristine->triangles[i];
+        for (unsigned int j = 0; j < shp->severed.size(); j++)
+            shp->adjacentnodes[shp->severed[j].first].insert(shp->severed[j].second);
+        shp->severed.clear();
+    }
+    return true;
+}
+
+// Like ship::build, but with the counting already done: every instance of a blueprint is the same
+// size, so each one's slice of the point and spring arrays is known up front, and the instances can
+// all be filled in at once.
+void phys::world::spawn(const blueprint &bp, const std::vector<placement> &at)
+{
+    if (at.empty() || bp.nodes.empty())
+        return;
+    for (unsigned int i = 0; i < bp.materials.size(); i++)
+        materialIndex(bp.materials[i]);     // now, so the tasks only ever look them up
+    int npoints = bp.nodes.size(), nsprings = bp.beams.size();
+    int firstpoint = points.size(), firstspring = springs.size();
+    points.resize(firstpoint + at.size() * npoints);
+    springs.resize(firstspring + at.size() * nsprings);
+    strains.resize(springs.size());
+    partitioned = false;
+    for (unsigned int i = 0; i < at.size(); i++)
+        springScheduler.schedule(new spawnTask(new ship(this), &bp, &at[i], firstpoint + i * npoints, firstspring + i * nsprings,
+                                               pointPool.claim(npoints), springPool.claim(nsprings)));
+    springScheduler.wait();
+    addPoints(firstpoint);
+}
+
+phys::world::spawnTask::spawnTask(ship *_shp, const blueprint *_bp, const placement *_at, int _pointbase, int _springbase, pool::run _pointslots, pool::run _springslots)
+{
+    shp = _shp;
+    bp = _bp;
+    at = _at;
+    pointbase = _pointbase;
+    springbase = _springbase;
+    pointslots = _pointslots;
+    springslots = _springslots;
+}
+
+void phys::world::spawnTask::process()
+{
+    shp->instantiate(*bp, *at, pointbase, springbase, pointslots, springslots);
+}
+
+const char *phys::world::spawnTask::getName()
+{
+    return "spawn";
+}
+
 // Copy parameters and set up initial params:
-phys::world::world(vec2f _gravity, double _buoyancy, double _strength)
+phys::world::world(vec2 _gravity, real _buoyancy, real _strength, int _nthreads, bool _pin):
+    springScheduler(_nthreads, _pin), pointPool(sizeof(point)), springPool(sizeof(spring))
 {
     time = 0;
     gravity = _gravity;
@@ -260,20 +507,25 @@ phys::world::world(vec2f _gravity, double _buoyancy, double _strength)
     waterpressure = 0.3;
     waveheight = 1.0;
     seadepth = 150;
+    immediatemode = false;
+    stressmap = false;
+    nhull = 0;
+    partitioned = false;
+    pristine = 0;
     collisionTree = BVHNode::allocateTree();
 }
 
-// Destroy everything in the set order
 phys::world::~world()
 {
     // DESTROY THE WORLD??? Y/N
-    for (unsigned int i = 0; i < springs.size(); i++)
-        delete springs[i];
-    springs.clear();
-    for (unsigned int i = 0; i < points.size(); i++)
-        delete points[i];
+    // Nothing outside the world refers to its points and springs, and they own nothing outside their
+    // pools, so there's no need for their destructors to unpick the references between them: each pool
+    // goes back to the heap whole.
     for (unsigned int i = 0; i < ships.size(); i++)
         delete ships[i];
+    springPool.release();
+    pointPool.release();
+    delete pristine;
 }
 
 // PPPP       OOO    IIIIIII  N     N  TTTTTTT
@@ -286,85 +538,119 @@ phys::world::~world()
 // P         O   O      I     N    NN     T
 // P          OOO    IIIIIII  N     N     T
 
+void *phys::point::operator new(size_t size, world *parent)
+{
+    return parent->pointPool.allocate();
+}
+
+void phys::point::operator delete(void *p, world *parent)
+{
+    pool::free(p);
+}
+
+void *phys::point::operator new(size_t size, void *slot)
+{
+    return slot;
+}
+
+void phys::point::operator delete(void *p, void *slot)
+{
+    pool::free(p);
+}
+
+void phys::point::operator delete(void *p)
+{
+    pool::free(p);
+}
+
 // Just copies parameters into relevant fields:
-phys::point::point(world *_parent, vec2 _pos, material *_mtl, double _buoyancy)
+phys::point::point(world *_parent, vec2 _pos, material *_mtl, real _buoyancy, int _index)
 {
     wld = _parent;
-    wld->points.push_back(this);
     pos = _pos;
     lastpos = pos;
-    mtl = _mtl;
+    mtlid = wld->materialIndex(_mtl);
+    mass = _mtl->mass;
     buoyancy = _buoyancy;
     isLeaking = false;
     water = 0;
+    index = -1;
+    shp = 0;
+    ntris = 0;
+    colour = _mtl->colour;  // dry
+    if (_index < 0)
+    {
+        wld->points.push_back(this);    // (last, as addPoints reads the point)
+        wld->addPoints(wld->points.size() - 1);
+    }
+    else
+        wld->points[_index] = this;     // (the builder sorts these itself once they're all in)
 }
 
-void phys::point::applyForce(vec2f f)
+void phys::point::applyForce(vec2 f)
 {
     force += f;
 }
 
-void phys::point::update(double dt)
+// Interior points get heavier as they fill with water, and float. Hull points have no buoyancy, so do
+// neither, and their kernel leaves out all of that arithmetic.
+template <bool buoyant> void phys::point::update(real dt, real drag)
 {
-    double mass = mtl->mass;
-    this->applyForce(wld->gravity * (mass * (1 + fmin(water, 1) * wld->buoyancy * buoyancy)));    // clamp water to 1, so high pressure areas are not heavier.
-    // Buoyancy:
-    if (pos.y < wld->waterheight(pos.x))
-        this->applyForce(wld->gravity * (-wld->buoyancy * buoyancy * mass));
-    vec2f newlastpos = pos;
+    real waterline = wld->waterheight(pos.x);
+    real weight = mass;
+    if (buoyant)
+    {
+        real lift = wld->buoyancy * buoyancy;
+        weight *= 1 + std::min(water, (real)1) * lift;     // clamp water to 1, so high pressure areas are not heavier.
+        if (pos.y < waterline)
+            weight -= lift * mass;
+    }
+    force += wld->gravity * weight;
+    vec2 newlastpos = pos;
     // Water drag:
-    if (pos.y < wld->waterheight(pos.x))
-        lastpos += (pos - lastpos) * (1 - pow(0.6, dt));
+    if (pos.y < waterline)
+        lastpos += (pos - lastpos) * drag;
     // Apply verlet integration:
     pos += (pos - lastpos) + force * (dt * dt / mass);
     // Collision with seafloor:
-    float floorheight = wld->oceanfloorheight(pos.x);
+    real floorheight = wld->oceanfloorheight(pos.x);
     if (pos.y < floorheight)
     {
-        vec2f dir = vec2f(floorheight - wld->oceanfloorheight(pos.x + 0.01f), 0.01f).normalise();   // -1 / derivative  => perpendicular to surface!
+        vec2 dir = vec2(floorheight - wld->oceanfloorheight(pos.x + 0.01f), 0.01f).normalise();   // -1 / derivative  => perpendicular to surface!
         pos += dir * (floorheight - pos.y);
     }
     lastpos = newlastpos;
-    force = vec2f(0, 0);
+    force = vec2(0, 0);
 }
 
-vec2f phys::point::getPos()
+vec2 phys::point::getPos()
 {
     return pos;
 }
 
 vec3f phys::point::getColour(vec3f basecolour)
 {
-   double wetness = fmin(water, 1) * 0.7;
+   float wetness = std::min(water, (real)1) * 0.7f;
    return basecolour * (1 - wetness) + vec3f(0, 0, 0.8) * wetness;
 }
 
 void phys::point::breach()
 {
+    if (!isLeaking)
+        wld->leaking.push_back(this);
     isLeaking = true;
-    for (std::set<ship::triangle*>::iterator iter = tris.begin(); iter != tris.end();)
-    {
-        ship::triangle *t = *iter;
-        iter++;
-        delete t;
-    }
+    while (ntris)
+        shp->removeTriangle(tris[ntris - 1]);
 }
 
-void phys::point::render()
+real phys::point::getPressure()
 {
-    // Put a blue blob on leaking nodes (was more for debug purposes, but looks better IMO)
-    if (isLeaking)
-    {
-        glColor3f(0, 0, 1);
-        glBegin(GL_POINTS);
-        glVertex3f(pos.x, pos.y, -1);
-        glEnd();
-    }
+    return wld->gravity.length() * std::max(-pos.y, (real)0) * (real)0.1;  // 0.1 = scaling constant, represents 1/ship width
 }
 
-double phys::point::getPressure()
+material *phys::point::getMaterial()
 {
-    return wld->gravity.length() * fmax(-pos.y, 0) * 0.1;  // 0.1 = scaling constant, represents 1/ship width
+    return wld->materials[mtlid];
 }
 
 phys::AABB phys::point::getAABB()
@@ -388,11 +674,16 @@ phys::point::~point()
         }
     }
     // remove any references:
-    for (unsigned int i = 0; i < wld->ships.size(); i++)
-        wld->ships[i]->points.erase(this);
+    std::vector<point*>::iterator leak = std::find(wld->leaking.begin(), wld->leaking.end(), this);
+    if (leak != wld->leaking.end())
+        wld->leaking.erase(leak);
     std::vector<point*>::iterator iter = std::find(wld->points.begin(), wld->points.end(), this);
     if (iter != wld->points.end())
+    {
+        if (iter - wld->points.begin() < wld->nhull)
+            wld->nhull--;
         wld->points.erase(iter);
+    }
 }
 
 //   SSS    PPPP     RRRR     IIIIIII  N     N    GGGGG
@@ -405,17 +696,56 @@ phys::point::~point()
 // SS   SS  P        R    R      I     N    NN   GG  GG
 //   SSS    P        R     R  IIIIIII  N     N    GGGG
 
-phys::spring::spring(world *_parent, point *_a, point *_b, material *_mtl, double _length)
+void *phys::spring::operator new(size_t size, world *parent)
+{
+    return parent->springPool.allocate();
+}
+
+void phys::spring::operator delete(void *p, world *parent)
+{
+    pool::free(p);
+}
+
+void *phys::spring::operator new(size_t size, void *slot)
+{
+    return slot;
+}
+
+void phys::spring::operator delete(void *p, void *slot)
+{
+    pool::free(p);
+}
+
+void phys::spring::operator delete(void *p)
+{
+    pool::free(p);
+}
+
+phys::spring::spring(world *_parent, point *_a, point *_b, material *_mtl, real _length, int _index)
 {
-    wld = _parent;
-    _parent->springs.push_back(this);
     a = _a;
     b = _b;
     if (_length == -1)
         length = (a->pos - b->pos).length();
     else
         length = _length;
-    mtl = _mtl;
+    mtlid = _parent->materialIndex(_mtl);
+    // * 0.85 => 25% overcorrection (stiffer, converges faster); if b is heavier, a moves more (and vice versa)
+    real correction = 1 / (length * (a->mass + b->mass) * (real)0.85);
+    aweight = b->mass * correction;
+    bweight = a->mass * correction;
+    real strain = (a->pos - b->pos).length() / length;
+    if (_index < 0)
+    {
+        _parent->springs.push_back(this);
+        _parent->partitioned = false;
+        _parent->strains.push_back(strain);
+    }
+    else
+    {
+        _parent->springs[_index] = this;     // (the builder marks the partition stale itself)
+        _parent->strains[_index] = strain;
+    }
 }
 
 phys::spring::~spring()
@@ -424,62 +754,71 @@ phys::spring::~spring()
     a->breach();
     b->breach();
     // Scour out any references to this spring
+    world *wld = a->wld;
     for (unsigned int i = 0; i < wld->ships.size(); i++)
     {
         ship *shp = wld->ships[i];
-        if (shp->adjacentnodes.find(a) != shp->adjacentnodes.end())
-            shp->adjacentnodes[a].erase(b);
-        if (shp->adjacentnodes.find(b) != shp->adjacentnodes.end())
-            shp->adjacentnodes[b].erase(a);
+        // (Keys are never erased, only their neighbours, so a reset can find the sets to put these back into)
+        if (shp->adjacentnodes.find(a) != shp->adjacentnodes.end() && shp->adjacentnodes[a].erase(b) && wld->pristine)
+            shp->severed.push_back(std::make_pair(a, b));
+        if (shp->adjacentnodes.find(b) != shp->adjacentnodes.end() && shp->adjacentnodes[b].erase(a) && wld->pristine)
+            shp->severed.push_back(std::make_pair(b, a));
     }
     std::vector <spring*>::iterator iter = std::find(wld->springs.begin(), wld->springs.end(), this);
     if (iter != wld->springs.end())
+    {
+        wld->strains.erase(wld->strains.begin() + (iter - wld->springs.begin()));
         wld->springs.erase(iter);
+        wld->partitioned = false;
+    }
 }
 
 void phys::spring::update()
 {
     // Try to space the two points by the equilibrium length (need to iterate to actually achieve this for all points, but it's FAAAAST for each step)
-    vec2f correction_dir = (b->pos - a->pos);
-    float currentlength = correction_dir.length();
-    correction_dir *= (length - currentlength) / (length * (a->mtl->mass + b->mtl->mass) * 0.85); // * 0.8 => 25% overcorrection (stiffer, converges faster)
-    a->pos -= correction_dir * b->mtl->mass;    // if b is heavier, a moves more.
-    b->pos += correction_dir * a->mtl->mass;    // (and vice versa...)
+    // (the mass ratio and overcorrection are folded into aweight and bweight when the spring is made)
+    vec2 correction_dir = (b->pos - a->pos);
+    real error = length - correction_dir.length();
+    a->pos -= correction_dir * (error * aweight);
+    b->pos += correction_dir * (error * bweight);
 }
 
-void phys::spring::damping(float amount)
+real phys::spring::damping(real amount)
 {
-    vec2f springdir = (a->pos - b->pos).normalise();
+    vec2 springdir = a->pos - b->pos;
+    real currentlength = springdir.length();
+    springdir *= 1 / currentlength;
     springdir *= (a->pos - a->lastpos - (b->pos - b->lastpos)).dot(springdir) * amount;   // relative velocity  spring direction = projected velocity, amount = amount of projected velocity that remains after damping
     a->lastpos += springdir;
     b->lastpos -= springdir;
+    return currentlength / length;
 }
 
-void phys::spring::render(bool showStress)
+vec3f phys::spring::getColour(point *end)
 {
-    // If member is heavily stressed, highlight it in red (ignored if world's showstress field is false)
-    glBegin(GL_LINES);
-    if (showStress)
-        glColor3f(1, 0, 0);
-    else
-        render::setColour(a->getColour(mtl->colour));
-    glVertex3f(a->pos.x, a->pos.y, -1);
-    if (!showStress)
-        render::setColour(b->getColour(mtl->colour));
-    glVertex3f(b->pos.x, b->pos.y, -1);
-    glEnd();
+    // Most springs are the same material as their ends, so can use the end's colour as is
+    return mtlid == end->mtlid ? end->colour : end->getColour(getMaterial()->colour);
+}
+
+material *phys::spring::getMaterial()
+{
+    return a->wld->materials[mtlid];
 }
 
-bool phys::spring::isStressed()
+real phys::spring::getStrength()
 {
-    // Check whether strain is more than the word's base strength * this object's relative strength
-    return (a->pos - b->pos).length() / this->length > 1 + (wld->strength * mtl->strength) * 0.25;
+    // The world's base strength * this object's relative strength
+    return a->wld->strength * getMaterial()->strength;
 }
 
-bool phys::spring::isBroken()
+bool phys::spring::isStressed(real strain)
 {
-    // Check whether strain is more than the word's base strength * this object's relative strength
-    return (a->pos - b->pos).length() / this->length > 1 + (wld->strength * mtl->strength);
+    return strain > 1 + getStrength() * (real)0.25;
+}
+
+bool phys::spring::isBroken(real strain)
+{
+    return strain > 1 + getStrength();
 }
 
 
@@ -499,9 +838,8 @@ phys::ship::ship(world *_parent)
     wld->ships.push_back(this);
 }
 
-void phys::ship::update(double dt)
+void phys::ship::update(real dt)
 {
-    leakWater(dt);
     for (int i = 0; i < 4; i++)
     {
         gravitateWater(dt);
@@ -511,24 +849,24 @@ void phys::ship::update(double dt)
         balancePressure(dt);
 }
 
-void phys::ship::leakWater(double dt)
+void phys::world::leakWater(real dt)
 {
+    PROFILE_SCOPE("water: leak");
     // Stuff some water into all the leaking nodes, if they're not under too much pressure
-   for (std::set<point*>::iterator iter = points.begin(); iter != points.end(); iter++)
-   {
-        point *p = *iter;
-        double pressure = p->getPressure();
-        if (p->isLeaking && p->pos.y < wld->waterheight(p->pos.x) && p->water < 1.5)
-        {
-            p->water += dt * wld->waterpressure * (pressure - p->water);
-        }
-   }
+    for (unsigned int i = 0; i < leaking.size(); i++)
+    {
+        point *p = leaking[i];
+        if (p->pos.y < waterheight(p->pos.x) && p->water < (real)1.5)
+            p->water += dt * waterpressure * (p->getPressure() - p->water);
+    }
 }
 
-void phys::ship::gravitateWater(double dt)
+void phys::ship::gravitateWater(real dt)
 {
+    PROFILE_SCOPE("water: gravitate");
     // Water flows into adjacent nodes in a quantity proportional to the cos of angle the beam makes
     // against gravity (parallel with gravity => 1 (full flow), perpendicular = 0)
+    vec2 down = wld->gravity.normalise();
     for (std::map<point*, std::set<point*> >::iterator iter = adjacentnodes.begin();
          iter != adjacentnodes.end(); iter++)
     {
@@ -536,10 +874,10 @@ void phys::ship::gravitateWater(double dt)
         for (std::set<point*>::iterator second = iter->second.begin(); second != iter->second.end(); second++)
         {
             point *b = *second;
-            double cos_theta = (b->pos - a->pos).normalise().dot(wld->gravity.normalise());
+            real cos_theta = (b->pos - a->pos).normaliseApprox().dot(down);  // (approximate is plenty for a flow rate)
             if (cos_theta > 0)
             {
-                double correction = std::min(0.5 * cos_theta * dt, a->water);   // The 0.5 can be tuned, it's just to stop all the water being stuffed into the first node...
+                real correction = std::min((real)0.5 * cos_theta * dt, a->water);   // The 0.5 can be tuned, it's just to stop all the water being stuffed into the first node...
                 a->water -= correction;
                 b->water += correction;
             }
@@ -548,8 +886,9 @@ void phys::ship::gravitateWater(double dt)
 
 }
 
-void phys::ship::balancePressure(double dt)
+void phys::ship::balancePressure(real dt)
 {
+    PROFILE_SCOPE("water: balance");
     // If there's too much water in this node, try and push it into the others
     // (This needs to iterate over multiple frames for pressure waves to spread through water)
     for (std::map<point*, std::set<point*> >::iterator iter = adjacentnodes.begin();
@@ -561,48 +900,297 @@ void phys::ship::balancePressure(double dt)
         for (std::set<point*>::iterator second = iter->second.begin(); second != iter->second.end(); second++)
         {
             point *b = *second;
-            double correction = (b->water - a->water) * 8 * dt; // can tune this number; value of 1 means will equalise in 1 second.
+            real correction = (b->water - a->water) * 8 * dt; // can tune this number; value of 1 means will equalise in 1 second.
             a->water += correction;
             b->water -= correction;
         }
     }
 }
 
-void phys::ship::render()
+// Pixel offsets of the 8 neighbours of a node, going clockwise from +x
+const int directions[8][2] = {
+{ 1,  0},
+{ 1, -1},
+{ 0, -1},
+{-1, -1},
+{-1,  0},
+{-1,  1},
+{ 0,  1},
+{ 1,  1}
+};
+
+material *materialAt(const std::vector<material*> &grid, int width, int height, int x, int y)
+{
+    if (x < 0 || x >= width || y < 0 || y >= height)
+        return 0;
+    return grid[x + y * width];
+}
+
+phys::point *nodeAt(const std::vector<phys::point*> &nodes, int width, int height, int x, int y)
+{
+    if (x < 0 || x >= width || y < 0 || y >= height)
+        return 0;
+    return nodes[x + y * width];
+}
+
+int countRowSprings(const std::vector<material*> &grid, int width, int height, int y)
+{
+    int count = 0;
+    for (int x = 0; x < width; x++)
+    {
+        if (!grid[x + y * width])
+            continue;
+        for (int i = 0; i < 4; i++)
+            if (materialAt(grid, width, height, x + directions[i][0], y + directions[i][1]))
+                count++;
+    }
+    return count;
+}
+
+// Fill in all the beams from the nodes on row y. These only ever reach row y and row y - 1.
+// If beam joins two hull nodes, it is a hull beam.
+// If a non-hull node has empty space on one of its four sides, it is automatically leaking.
+void connectRow(phys::ship *shp, phys::ship::buildBand &band, int &springindex, int y,
+                const std::vector<material*> &grid, const std::vector<phys::point*> &nodes, int width, int height)
+{
+    for (int x = 0; x < width; x++)
+    {
+        phys::point *a = nodes[x + y * width];
+        if (!a)
+            continue;
+        // First four directions out of 8: from 0 deg (+x) through to 135 deg (-x +y) - this covers each pair of points in each direction
+        for (int i = 0; i < 4; i++)
+        {
+            phys::point *b = nodeAt(nodes, width, height, x + directions[i][0], y + directions[i][1]);                        // adjacent point in direction (i)
+            phys::point *c = nodeAt(nodes, width, height, x + directions[(i + 1) % 8][0], y + directions[(i + 1) % 8][1]);    // adjacent point in next CW direction (for constructing triangles)
+            if (b)
+            {
+                bool pointIsHull = a->getMaterial()->isHull;
+                bool isHull = pointIsHull && b->getMaterial()->isHull;
+                material *mtl = b->getMaterial()->isHull? a->getMaterial() : b->getMaterial();  // the spring is hull iff both nodes are hull; if so we use the hull material.
+                new (band.springslots[springindex - band.springbase]) phys::spring(shp->wld, a, b, mtl, -1, springindex);
+                springindex++;
+                if (!isHull)
+                    band.adjacent.push_back(std::make_pair(a, b));
+                if (!(pointIsHull || (materialAt(grid, width, height, x + 1, y) && materialAt(grid, width, height, x, y + 1) &&
+                                      materialAt(grid, width, height, x - 1, y) && materialAt(grid, width, height, x, y - 1))))   // check for gaps next to non-hull areas:
+                {
+                    a->isLeaking = true;
+                }
+                if (c)
+                    band.tris.push_back(phys::ship::triangle(a, b, c));
+            }
+        }
+    }
+}
+
+// Build the ship's points, springs and triangles from a grid of materials.
+// The grid is cut into horizontal bands which are counted and then filled in parallel: each band gets
+// its own contiguous range of the world's point and spring arrays, and its own run of pool slots, so no
+// two workers touch the same slot or wait on each other for one.
+void phys::ship::build(const std::vector<material*> &grid, int width, int height)
 {
-    for (std::set<ship::triangle*>::iterator iter = triangles.begin(); iter != triangles.end(); iter++)
+    if (width <= 0 || height <= 0)
+        return;
+    scheduler &sched = wld->springScheduler;
+    int nbands = imin(sched.getNThreads(), height);
+    std::vector<buildBand> bands(nbands);
+    for (int i = 0; i < nbands; i++)
     {
-        triangle *t = *iter;
-        render::triangle(t->a->pos, t->b->pos, t->c->pos,
-                         t->a->getColour(t->a->mtl->colour),
-                         t->b->getColour(t->b->mtl->colour),
-                         t->c->getColour(t->c->mtl->colour));
+        bands[i].firstrow = height * i / nbands;
+        bands[i].lastrow = height * (i + 1) / nbands;
+        sched.schedule(new buildBandTask(this, &bands[i], &grid, 0, width, height));
+    }
+    // Give the grid's materials their indices now, so the bands only ever look them up
+    material *last = 0;
+    for (unsigned int i = 0; i < grid.size(); i++)
+        if (grid[i] && grid[i] != last)
+            wld->materialIndex(last = grid[i]);
+    sched.wait();
+
+    // Prefix sum of the counts gives each band its slice of the world's arrays:
+    int firstpoint = wld->points.size(), firstspring = wld->springs.size();
+    int pointbase = firstpoint, springbase = firstspring;
+    for (int i = 0; i < nbands; i++)
+    {
+        bands[i].pointbase = pointbase;
+        bands[i].springbase = springbase;
+        bands[i].pointslots = wld->pointPool.claim(bands[i].pointcount);
+        bands[i].springslots = wld->springPool.claim(bands[i].springcount);
+        pointbase += bands[i].pointcount;
+        springbase += bands[i].springcount;
+    }
+    wld->points.resize(pointbase);
+    wld->springs.resize(springbase);
+    wld->strains.resize(springbase);
+    wld->partitioned = false;
+
+    std::vector<point*> nodes(width * height, (point*)0);
+    for (int i = 0; i < nbands; i++)
+        sched.schedule(new buildBandTask(this, &bands[i], &grid, &nodes, width, height));
+    sched.wait();
+
+    // Stitch the seams: the first row of each band joins onto the last row of the band below.
+    for (int i = 1; i < nbands; i++)
+    {
+        int springindex = bands[i].springbase;
+        connectRow(this, bands[i], springindex, bands[i].firstrow, grid, nodes, width, height);
+    }
+
+    int ntris = triangles.size();
+    for (int i = 0; i < nbands; i++)
+        ntris += bands[i].tris.size();
+    triangles.reserve(ntris);
+    for (int i = 0; i < nbands; i++)
+    {
+        for (unsigned int j = 0; j < bands[i].adjacent.size(); j++)
+        {
+            adjacentnodes[bands[i].adjacent[j].first].insert(bands[i].adjacent[j].second);
+            adjacentnodes[bands[i].adjacent[j].second].insert(bands[i].adjacent[j].first);
+        }
+        for (unsigned int j = 0; j < bands[i].tris.size(); j++)
+            addTriangle(bands[i].tris[j]);
+    }
+    wld->addPoints(firstpoint);
+}
+
+phys::ship::buildBandTask::buildBandTask(ship *_shp, buildBand *_band, const std::vector<material*> *_grid, std::vector<point*> *_nodes, int _width, int _height)
+{
+    shp = _shp;
+    band = _band;
+    grid = _grid;
+    nodes = _nodes;
+    width = _width;
+    height = _height;
+}
+
+void phys::ship::buildBandTask::process()
+{
+    if (!nodes)
+    {
+        band->pointcount = 0;
+        band->springcount = 0;
+        band->seamspringcount = 0;
+        for (int y = band->firstrow; y < band->lastrow; y++)
+        {
+            for (int x = 0; x < width; x++)
+                if ((*grid)[x + y * width])
+                    band->pointcount++;
+            int rowsprings = countRowSprings(*grid, width, height, y);
+            band->springcount += rowsprings;
+            if (y == band->firstrow && y > 0)
+                band->seamspringcount = rowsprings;
+        }
+        return;
+    }
+    int pointindex = band->pointbase;
+    for (int y = band->firstrow; y < band->lastrow; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            material *mtl = (*grid)[x + y * width];
+            if (mtl)
+            {
+                point *p = new (band->pointslots[pointindex - band->pointbase]) point(shp->wld, vec2(x - width/2, y), mtl, mtl->isHull? 0 : 1, pointindex);  // no buoyancy if it's a hull section
+                pointindex++;
+                p->shp = shp;
+                (*nodes)[x + y * width] = p;
+            }
+        }
+    }
+    // The seam row's springs come first in this band's range; they are filled in later by ship::build.
+    int springindex = band->springbase + band->seamspringcount;
+    for (int y = band->firstrow > 0 ? band->firstrow + 1 : 0; y < band->lastrow; y++)
+        connectRow(shp, *band, springindex, y, *grid, *nodes, width, height);
+}
+
+const char *phys::ship::buildBandTask::getName()
+{
+    return nodes ? "build band" : "count band";
+}
+
+// The blueprint's indices are rebased onto this ship's slices of the world's arrays as they're read.
+// Rest lengths come from the blueprint too, since turning and moving a ship doesn't change them.
+void phys::ship::instantiate(const blueprint &bp, const placement &at, int pointbase, int springbase, pool::run pointslots, pool::run springslots)
+{
+    real c = std::cos(at.angle), s = std::sin(at.angle);
+    std::vector<point*> made(bp.nodes.size());
+    for (unsigned int i = 0; i < bp.nodes.size(); i++)
+    {
+        const blueprint::node &n = bp.nodes[i];
+        vec2 pos(n.pos.x * c - n.pos.y * s + at.offset.x, n.pos.x * s + n.pos.y * c + at.offset.y);
+        made[i] = new (pointslots[i]) point(wld, pos, bp.materials[n.mtl], n.buoyancy, pointbase + i);
+        made[i]->shp = this;
+        made[i]->isLeaking = n.leaking;     // (world::spawn's addPoints lists these once they're all in)
+    }
+    for (unsigned int i = 0; i < bp.beams.size(); i++)
+    {
+        const blueprint::beam &b = bp.beams[i];
+        new (springslots[i]) spring(wld, made[b.a], made[b.b], bp.materials[b.mtl], b.length, springbase + i);
+    }
+    triangles.reserve(triangles.size() + bp.faces.size());
+    for (unsigned int i = 0; i < bp.faces.size(); i++)
+        addTriangle(triangle(made[bp.faces[i].a], made[bp.faces[i].b], made[bp.faces[i].c]));
+    for (unsigned int i = 0; i < bp.adjacent.size(); i++)
+    {
+        adjacentnodes[made[bp.adjacent[i].first]].insert(made[bp.adjacent[i].second]);
+        adjacentnodes[made[bp.adjacent[i].second]].insert(made[bp.adjacent[i].first]);
     }
 }
 
 phys::ship::~ship()
 {
-    /*for (unsigned int i = 0; i < triangles.size(); i++)
-        delete triangles[i];*/
 }
 
-phys::ship::triangle::triangle(phys::ship *_parent, point *_a, point *_b, point *_c)
+phys::ship::triangle::triangle(point *_a, point *_b, point *_c)
 {
-    parent = _parent;
     a = _a;
     b = _b;
     c = _c;
-    a->tris.insert(this);
-    b->tris.insert(this);
-    c->tris.insert(this);
 }
 
-phys::ship::triangle::~triangle()
+// Replace triangle index from with to in a point's list, or drop it if to < 0 (order doesn't matter).
+void renumberTriangle(phys::point *p, int from, int to)
 {
-    parent->triangles.erase(this);
-    a->tris.erase(this);
-    b->tris.erase(this);
-    c->tris.erase(this);
+    for (int i = 0; i < p->ntris; i++)
+        if (p->tris[i] == from)
+        {
+            p->tris[i] = to >= 0 ? to : p->tris[--p->ntris];
+            return;
+        }
+}
+
+// A point has room for MAX_TRIANGLES, which is all the grid builder can give it. Anything that would
+// go over is left out rather than written past the end of the point's list.
+void phys::ship::addTriangle(const triangle &t)
+{
+    if (t.a->ntris >= point::MAX_TRIANGLES || t.b->ntris >= point::MAX_TRIANGLES || t.c->ntris >= point::MAX_TRIANGLES)
+    {
+        std::cout << "Error: triangle left out, a corner already has " << point::MAX_TRIANGLES << "\n";
+        return;
+    }
+    int index = triangles.size();
+    triangles.push_back(t);
+    t.a->tris[t.a->ntris++] = index;
+    t.b->tris[t.b->ntris++] = index;
+    t.c->tris[t.c->ntris++] = index;
+}
+
+// Swap-remove: the last triangle moves into the gap, and its corners are told its new index.
+void phys::ship::removeTriangle(int t)
+{
+    renumberTriangle(triangles[t].a, t, -1);
+    renumberTriangle(triangles[t].b, t, -1);
+    renumberTriangle(triangles[t].c, t, -1);
+    int last = triangles.size() - 1;
+    if (t != last)
+    {
+        triangles[t] = triangles[last];
+        renumberTriangle(triangles[t].a, last, t);
+        renumberTriangle(triangles[t].b, last, t);
+        renumberTriangle(triangles[t].c, last, t);
+    }
+    triangles.pop_back();
 }
 
 phys::AABB::AABB(vec2 _bottomleft, vec2 _topright)
@@ -623,9 +1211,10 @@ void phys::AABB::extendTo(phys::AABB other)
         topright.y = other.topright.y;
 }
 
-void phys::AABB::render()
+bool phys::AABB::intersects(const phys::AABB &other)
 {
-    render::box(bottomleft, topright);
+    return bottomleft.x <= other.topright.x && other.bottomleft.x <= topright.x &&
+           bottomleft.y <= other.topright.y && other.bottomleft.y <= topright.y;
 }
 
 phys::BVHNode* phys::BVHNode::allocateTree(int depth)
@@ -637,3 +1226,73 @@ phys::BVHNode* phys::BVHNode::allocateTree(int depth)
     thisnode->r = allocateTree(depth - 1);
     return thisnode;
 }
+
+phys::placement::placement(vec2 _offset, real _angle)
+{
+    offset = _offset;
+    angle = _angle;
+}
+
+// Points and springs don't list their ship's, so pick them out of the world's. Materials keep the
+// world's numbering, which the blueprint's list is a copy of. The points are numbered in address order,
+// which instantiate() then makes them in, so each instance is laid out in memory as the original was:
+// the water flow visits neighbours in address order, so that's what makes a copy behave the same.
+phys::blueprint::blueprint(ship *shp)
+{
+    world *wld = shp->wld;
+    materials = wld->materials;
+    std::vector<point*> mine;
+    for (unsigned int i = 0; i < wld->points.size(); i++)
+        if (wld->points[i]->shp == shp)
+            mine.push_back(wld->points[i]);
+    std::sort(mine.begin(), mine.end());
+    std::map<point*, int> numbers;
+    for (unsigned int i = 0; i < mine.size(); i++)
+    {
+        point *p = mine[i];
+        node n;
+        n.pos = p->pos;
+        n.buoyancy = p->buoyancy;
+        n.mtl = p->mtlid;
+        n.leaking = p->isLeaking;
+        if (nodes.empty())
+            bounds = p->getAABB();
+        else
+            bounds.extendTo(p->getAABB());
+        numbers[p] = nodes.size();
+        nodes.push_back(n);
+    }
+    for (unsigned int i = 0; i < wld->springs.size(); i++)
+    {
+        spring *spr = wld->springs[i];
+        if (spr->a->shp != shp || spr->b->shp != shp)
+            continue;
+        beam b;
+        b.a = numbers[spr->a];
+        b.b = numbers[spr->b];
+        b.length = spr->length;
+        b.mtl = spr->mtlid;
+        beams.push_back(b);
+    }
+    for (unsigned int i = 0; i < shp->triangles.size(); i++)
+    {
+        face f;
+        f.a = numbers[shp->triangles[i].a];
+        f.b = numbers[shp->triangles[i].b];
+        f.c = numbers[shp->triangles[i].c];
+        faces.push_back(f);
+    }
+    for (std::map<point*, std::set<point*> >::iterator iter = shp->adjacentnodes.begin(); iter != shp->adjacentnodes.end(); iter++)
+        for (std::set<point*>::iterator other = iter->second.begin(); other != iter->second.end(); other++)
+            if (numbers[iter->first] < numbers[*other])
+                adjacent.push_back(std::make_pair(numbers[iter->first], numbers[*other]));
+}
+
+std::vector<phys::placement> phys::blueprint::convoy(int count, real gap)
+{
+    std::vector<placement> at;
+    real spacing = bounds.topright.x - bounds.bottomleft.x + gap;
+    for (int i = 1; i <= count; i++)
+        at.push_back(placement(vec2(-spacing * i, 0)));
+    return at;
+}
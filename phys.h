@@ -5,47 +5,109 @@
 #include <set>
 #include <vector>
 #include "material.h"
+#include "pool.h"
+#include "render.h"
 #include "scheduler.h"
 #include "vec.h"
 
 namespace phys
 {
-    class point; class spring; struct ship; class game; struct AABB; struct BVHNode;
+    class point; class spring; struct ship; class game; struct AABB; struct BVHNode; struct blueprint; struct placement;
+
+    // Everything needed to draw the world's objects as they were at one instant. Filling one of these
+    // at the end of a step lets the next step run while this one is being drawn.
+    struct snapshot
+    {
+        render::vertexArray points;     // every point; the index lists below refer into this
+        render::vertexArray springs;    // two vertices per spring
+        std::vector<unsigned int> leaks, triangles, stress;
+        float time;                     // for the waves
+        snapshot();
+    };
+
     class world
     {
+        friend struct blueprint;
         friend class point;
         friend class spring;
         friend class ship;
         struct springCalculateTask;
         struct pointIntegrateTask;
+        struct spawnTask;
         scheduler springScheduler;
-        std::vector <point*> points;
+        std::vector <point*> points;   // hull points (no buoyancy) first, then the rest, so each range gets its own kernel
+        int nhull;                      // points [0, nhull) are hull
+        std::vector <point*> leaking;   // every leaking point, so the leak pass needn't look at the others
         std::vector <spring*> springs;
+        std::vector <real> strains;    // each spring's length / rest length as of the last damping pass, kept in step with springs
+        // The springs are kept sorted by slab (see partitionSprings): with n slabs, springs
+        // [slabranges[s], slabranges[s + 1]) are interior to slab s for s < n, then come the seams between
+        // slabs s - n and s - n + 1, and last any that reach past a neighbouring slab.
+        std::vector <int> slabranges;
+        bool partitioned;               // false once springs have come or gone since the last partition
+        void partitionSprings();
+        void relaxRange(int first, int last, int worker);   // schedules springs [first, last) as one task, always on the same worker
         std::vector <ship*> ships;
+        pool pointPool, springPool;     // where every point and spring in this world lives
+        struct pristineCopy;
+        pristineCopy *pristine;         // 0 until savePristine()
+        std::vector <material*> materials;  // points and springs hold an index into this rather than a pointer
+        unsigned short materialIndex(material *mtl);    // adds it if it's new; not thread safe for new materials
         BVHNode *collisionTree;
-        float waterheight(float x);
-        float oceanfloorheight(float x);
-        void doSprings(double dt);
+        real waterheight(real x);
+        real waterheight(real x, real t);
+        real oceanfloorheight(real x);
         vec2 gravity;
         void buildBVHTree(bool splitInX, std::vector<point*> &pointlist, BVHNode *thisnode, int depth = 1);
+        void renderObjectsImmediate();
+        void renderSnapshot(const snapshot &s);
+        void leakWater(real dt);
+        void addPoints(int first);      // sort points [first, end) into the hull and buoyant ranges
+        static bool isHull(point *p);   // i.e. has no buoyancy, so takes the hull kernel
     public:
+        // Heap held by the world's objects, in bytes, for sizing ships against RAM. Each total covers the
+        // objects' own storage (pool slots, spare ones included) and the lists that refer to them.
+        struct memoryStats
+        {
+            int npoints, nsprings, ntriangles;
+            size_t points, springs, triangles;
+            size_t water;       // the ships' adjacency maps for water flow; estimated, since tree nodes aren't visible
+        };
         float *oceandepthbuffer;
-        float buoyancy;
-        float strength;
-        float waterpressure;
-        float waveheight;
-        float seadepth;
+        real buoyancy;
+        real strength;
+        real waterpressure;
+        real waveheight;
+        real seadepth;
         bool showstress;
+        bool stressmap;         // colour every spring by how close it is to breaking (vertex-array renderer only)
         bool quickwaterfix;
         bool xraymode;
-        float time;
-        void update(double dt);
-        void render(double left, double right, double bottom, double top);
+        bool immediatemode;     // draw with the old per-object glBegin/glEnd path instead of vertex arrays
+        real time;
+        void update(real dt);
+        void integratePoints(real dt);
+        void doSprings(real dt);
+        void removeBrokenSprings();
+        void updateShips(real dt);
+        void updateColours();
+        void capture(snapshot &s, const AABB &view);    // only what's in view; not thread safe against update(), so call between steps
+        void render(double left, double right, double bottom, double top, const snapshot *s = 0);   // 0 => draw the live objects
         void renderLand(double left, double right, double bottom, double top);
-        void renderWater(double left, double right, double bottom, double top);
+        void renderWater(double left, double right, double bottom, double top, float t);
         void destroyAt(vec2 pos);
         void drawTo(vec2 target);
-        world(vec2 _gravity = vec2(0, -9.8), double _buoyancy = 4, double _strength = 0.01);
+        int getNPoints();
+        int getNSprings();
+        int getNLeaking();
+        double getTotalWater();
+        float getSubmergedFraction();   // of the points, by count
+        scheduler &getScheduler();
+        memoryStats getMemoryStats();
+        void spawn(const blueprint &bp, const std::vector<placement> &at);    // one new ship per placement, built in parallel
+        void savePristine();        // remember everything as it is now (say, just after loading)...
+        bool restorePristine();     // ...and put it back, in place; false if nothing was saved or a ship has been added since
+        world(vec2 _gravity = vec2(0, -9.8), real _buoyancy = 4, real _strength = 0.01, int _nthreads = 0, bool _pin = false);  // 0 threads => one per core; pin => see scheduler
         ~world();
     };
 
@@ -55,15 +117,30 @@ namespace phys
         world *wld;
         int first, last;
         virtual void process();
+        virtual const char *getName();
     };
 
     struct world::pointIntegrateTask: scheduler::task
     {
-        pointIntegrateTask(world *_wld, int _first, int _last, float _dt);
+        pointIntegrateTask(world *_wld, int _first, int _last, real _dt);
         world *wld;
-        float dt;
+        real dt;
         int first, last;
         virtual void process();
+        virtual const char *getName();
+    };
+
+    // Instancing one blueprint as one ship, into slots world::spawn has already made room for
+    struct world::spawnTask: scheduler::task
+    {
+        spawnTask(ship *_shp, const blueprint *_bp, const placement *_at, int _pointbase, int _springbase, pool::run _pointslots, pool::run _springslots);
+        ship *shp;
+        const blueprint *bp;
+        const placement *at;
+        int pointbase, springbase;
+        pool::run pointslots, springslots;
+        virtual void process();
+        virtual const char *getName();
     };
 
 
@@ -71,28 +148,72 @@ namespace phys
     {
         world *wld;
         struct triangle {
-            ship *parent;
             point *a, *b, *c;
-            triangle(phys::ship *_parent, point *_a, point *_b, point *_c);
-            ~triangle();
+            triangle(point *_a, point *_b, point *_c);
             };
-        std::set<point*> points;
-        std::set<spring*> springs;
+        struct buildBand;
+        struct buildBandTask;
         std::map<point*, std::set<point*> > adjacentnodes;
-        std::set<triangle*> triangles;
+        std::vector<std::pair<point*, point*> > severed;   // entries erased from adjacentnodes since the world's pristine copy was saved (if it has one)
+        std::vector<triangle> triangles;    // in no particular order: removing one moves the last into its place
+        void addTriangle(const triangle &t);     // left out, with an error, if a corner has no room for it
+        void removeTriangle(int t);
         void render();
-        void leakWater(double dt);
-        void gravitateWater(double dt);
-        void balancePressure(double dt);
+        void gravitateWater(real dt);
+        void balancePressure(real dt);
+        void build(const std::vector<material*> &grid, int width, int height);  // grid is indexed [x + y * width], 0 = empty
+        void instantiate(const blueprint &bp, const placement &at, int pointbase, int springbase, pool::run pointslots, pool::run springslots);    // into claimed slots, as build's bands do
 
         ship(world *_parent);
         ~ship();
-        void update(double dt);
+        void update(real dt);
+    };
+
+    // A horizontal slice of the ship image, built independently of the others.
+    // The first row of each band (except the lowest) joins onto the band below, so is left for the seam pass.
+    struct ship::buildBand
+    {
+        int firstrow, lastrow;  // rows [firstrow, lastrow)
+        int pointcount, springcount, seamspringcount;
+        int pointbase, springbase;
+        pool::run pointslots, springslots;  // this band's points and springs, in the same order as its slices of the world's arrays
+        std::vector<std::pair<point*, point*> > adjacent;
+        std::vector<triangle> tris;
+    };
+
+    // The world as savePristine() found it. The pool images hold the points and springs themselves; the
+    // rest are the lists that refer to them, which are copied back into the world's own (never shrunk)
+    // vectors. The adjacency maps aren't copied at all: each ship keeps a note of what's been erased
+    // from its map since the save instead.
+    struct world::pristineCopy
+    {
+        pool::image pointSlots, springSlots;
+        std::vector<point*> points, leaking;
+        std::vector<spring*> springs;
+        std::vector<real> strains;
+        std::vector<int> slabranges;
+        int nhull;
+        bool partitioned;
+        real time;
+        std::vector<std::vector<ship::triangle> > triangles;    // one list per ship
+    };
+
+    struct ship::buildBandTask: scheduler::task
+    {
+        buildBandTask(ship *_shp, buildBand *_band, const std::vector<material*> *_grid, std::vector<point*> *_nodes, int _width, int _height);
+        ship *shp;
+        buildBand *band;
+        const std::vector<material*> *grid;
+        std::vector<point*> *nodes;     // 0 => count only
+        int width, height;
+        virtual void process();
+        virtual const char *getName();
     };
 
     class point
     {
         world *wld;
+        friend struct blueprint;
         friend class spring;
         friend class world;
         friend class ship;
@@ -100,18 +221,30 @@ namespace phys
         vec2 pos;
         vec2 lastpos;
         vec2 force;
-        double buoyancy;
-        double water;
-        double getPressure();
+        real buoyancy;
+        real mass;                      // copied from the material, to save the indirection in the integrator
+        real water;
+        real getPressure();
     public:
-        std::set<ship::triangle*> tris;
-        material *mtl;
+        static const int MAX_TRIANGLES = 12;    // a node is a corner of 3 of the 4 triangles in each of the 4 grid squares around it
+        int index;      // position in the world's point list, as of the last capture
+        ship *shp;                      // 0 if this isn't part of a ship
+        int tris[MAX_TRIANGLES];        // indices into shp->triangles of the triangles this is a corner of
+        vec3f colour;   // material colour tinted by water, as of the last step
+        unsigned short mtlid;           // see getMaterial()
+        unsigned char ntris;
         bool isLeaking;
-        point(world *_parent, vec2 _pos, material *_mtl, double _buoyancy);
+        material *getMaterial();
+        point(world *_parent, vec2 _pos, material *_mtl, real _buoyancy, int _index = -1);   // _index >= 0: fill a preallocated slot instead of appending
         ~point();
+        static void *operator new(size_t size, world *parent);    // from the world's pool: new (wld) point(wld, ...)
+        static void operator delete(void *p, world *parent);      // (only used if a constructor throws)
+        static void *operator new(size_t size, void *slot);       // into a slot of a run claimed from the world's pool
+        static void operator delete(void *p, void *slot);
+        static void operator delete(void *p);
         void applyForce(vec2 f);
         void breach();  // set to leaking and remove any incident triangles
-        void update(double dt);
+        template <bool buoyant> void update(real dt, real drag);    // buoyant = false for hull points, which have no buoyancy; drag is per step
         vec2 getPos();
         vec3f getColour(vec3f basecolour);
         AABB getAABB();
@@ -120,21 +253,30 @@ namespace phys
 
     class spring
     {
+        friend struct blueprint;
         friend class world;
         friend class point;
         friend class ship;
-        world *wld;
-        point *a, *b;
-        double length;
-        material *mtl;
+        point *a, *b;                   // (the world is a->wld)
+        real length;
+        real aweight, bweight;          // how far each end moves per unit of error: the other end's share of the mass, over the rest length
+        unsigned short mtlid;
     public:
-        spring(world *_parent, point *_a, point *_b, material *_mtl, double _length = -1);
+        material *getMaterial();
+        spring(world *_parent, point *_a, point *_b, material *_mtl, real _length = -1, int _index = -1);
         ~spring();
+        static void *operator new(size_t size, world *parent);    // new (wld) spring(wld, ...), as for points
+        static void operator delete(void *p, world *parent);
+        static void *operator new(size_t size, void *slot);
+        static void operator delete(void *p, void *slot);
+        static void operator delete(void *p);
         void update();
-        void damping(float amount);
+        real damping(real amount);      // returns the strain, so the solver can record it
         void render(bool isStressed = false);
-        bool isStressed();
-        bool isBroken();
+        vec3f getColour(point *end);    // this spring's material, as wet as the given end
+        real getStrength();             // strain above 1 at which this breaks
+        bool isStressed(real strain);
+        bool isBroken(real strain);
     };
 
     struct AABB
@@ -143,6 +285,7 @@ namespace phys
         AABB() {}
         AABB(vec2 _bottomleft, vec2 _topright);
         void extendTo(AABB other);
+        bool intersects(const AABB &other);
         void render();
     };
 
@@ -157,6 +300,47 @@ namespace phys
         point* points[MAX_N_POINTS];
         static BVHNode *allocateTree(int depth = MAX_DEPTH);
     };
+
+    // Where to put one instance of a blueprint: turned by angle (radians, anticlockwise) about the
+    // blueprint's origin, then moved by offset.
+    struct placement
+    {
+        vec2 offset;
+        real angle;
+        placement(vec2 _offset = vec2(0, 0), real _angle = 0);
+    };
+
+    // A ship compiled down to plain lists, with its points numbered from 0 and nothing tying it to a
+    // world, so it can be instanced any number of times without going back to the image. Every
+    // instance shares the one list of materials (and the material objects themselves).
+    struct blueprint
+    {
+        struct node
+        {
+            vec2 pos;
+            real buoyancy;
+            unsigned short mtl;     // index into materials
+            bool leaking;           // an opening in the ship as built, which lets water in from the start
+        };
+        struct beam
+        {
+            int a, b;
+            real length;
+            unsigned short mtl;
+        };
+        struct face
+        {
+            int a, b, c;
+        };
+        std::vector<material*> materials;
+        std::vector<node> nodes;
+        std::vector<beam> beams;
+        std::vector<face> faces;
+        std::vector<std::pair<int, int> > adjacent;     // water flow neighbours, each pair once
+        AABB bounds;
+        blueprint(ship *shp);       // as it is now, so normally straight after it's built
+        std::vector<placement> convoy(int count, real gap);     // count more in a line off to the left (-x) of the original, gap metres apart
+    };
 }
 
 
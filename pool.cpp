@@ -0,0 +1,152 @@
+#include "pool.h"
+
+#include <cstring>
+#include <new>
+
+pool::pool(size_t _objectsize, int _chunkslots)
+{
+    if (_objectsize < sizeof(slot*))
+        _objectsize = sizeof(slot*);
+    slotsize = HEADER + (_objectsize + HEADER - 1) / HEADER * HEADER;
+    chunkslots = _chunkslots;
+    nslots = 0;
+    freelist = 0;
+    nlive = 0;
+}
+
+pool::~pool()
+{
+    release();
+}
+
+void pool::grow()
+{
+    addChunk(chunkslots);
+    freeChunk(chunks.back());
+}
+
+char *pool::addChunk(int n)
+{
+    chunk c;
+    c.memory = (char*)::operator new(slotsize * n);
+    c.nslots = n;
+    chunks.push_back(c);
+    nslots += n;
+    return c.memory;
+}
+
+// Thread all of a chunk's slots onto the free list, first slot first.
+void pool::freeChunk(const chunk &c)
+{
+    for (int i = c.nslots - 1; i >= 0; i--)
+    {
+        slot *s = (slot*)(c.memory + i * slotsize);
+        s->owner = this;
+        s->next = freelist;
+        freelist = s;
+    }
+}
+
+void *pool::allocate()
+{
+    tthread::lock_guard<tthread::mutex> guard(m);
+    if (!freelist)
+        grow();
+    slot *s = freelist;
+    freelist = s->next;
+    nlive++;
+    return (char*)s + HEADER;
+}
+
+void pool::free(void *object)
+{
+    if (!object)
+        return;
+    slot *s = (slot*)((char*)object - HEADER);
+    pool *owner = s->owner;
+    tthread::lock_guard<tthread::mutex> guard(owner->m);
+    s->next = owner->freelist;
+    owner->freelist = s;
+    owner->nlive--;
+}
+
+pool::run pool::claim(int n)
+{
+    run r;
+    if (n <= 0)
+        return r;
+    tthread::lock_guard<tthread::mutex> guard(m);
+    r.first = addChunk(n);
+    r.slotsize = slotsize;
+    for (int i = 0; i < n; i++)
+        ((slot*)(r.first + i * slotsize))->owner = this;
+    nlive += n;
+    return r;
+}
+
+pool::run::run()
+{
+    first = 0;
+    slotsize = 0;
+}
+
+void *pool::run::operator[](int i) const
+{
+    return first + i * slotsize + HEADER;
+}
+
+void pool::release()
+{
+    tthread::lock_guard<tthread::mutex> guard(m);
+    for (unsigned int i = 0; i < chunks.size(); i++)
+        ::operator delete(chunks[i].memory);
+    chunks.clear();
+    nslots = 0;
+    freelist = 0;
+    nlive = 0;
+}
+
+void pool::save(image &img)
+{
+    tthread::lock_guard<tthread::mutex> guard(m);
+    img.bytes.resize(nslots * slotsize);
+    size_t offset = 0;
+    for (unsigned int i = 0; i < chunks.size(); i++)
+    {
+        memcpy(&img.bytes[offset], chunks[i].memory, chunks[i].nslots * slotsize);
+        offset += chunks[i].nslots * slotsize;
+    }
+    img.freelist = freelist;
+    img.nlive = nlive;
+    img.nchunks = chunks.size();
+}
+
+// Chunks only ever get added (short of a release), so the image's chunks are still the first ones here
+// and can be copied straight back. Any added since (grown or claimed) are wholly free again.
+bool pool::restore(const image &img)
+{
+    tthread::lock_guard<tthread::mutex> guard(m);
+    if ((int)chunks.size() < img.nchunks)
+        return false;
+    size_t offset = 0;
+    for (int i = 0; i < img.nchunks; i++)
+    {
+        memcpy(chunks[i].memory, &img.bytes[offset], chunks[i].nslots * slotsize);
+        offset += chunks[i].nslots * slotsize;
+    }
+    freelist = img.freelist;
+    nlive = img.nlive;
+    for (unsigned int i = img.nchunks; i < chunks.size(); i++)
+        freeChunk(chunks[i]);
+    return true;
+}
+
+int pool::getNLive()
+{
+    return nlive;
+}
+
+size_t pool::getNBytes()
+{
+    return nslots * slotsize;
+}
@@ -0,0 +1,69 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <cstddef>
+#include <vector>
+#include "tinythread.h"
+
+// Fixed-size slots for one kind of object, carved out of large chunks. Freed slots go on a free list
+// and are handed out again, so once a pool has grown to its working size, making and destroying
+// objects never touches the heap. Each slot remembers its pool, so a class's operator delete can give
+// the slot back without being told where it came from. Allocating and freeing are thread safe. Builders
+// that make many objects at once claim a run of slots instead, and fill it without taking the lock.
+class pool
+{
+    struct slot
+    {
+        pool *owner;        // the object comes straight after this
+        slot *next;         // (only while free, when it overlaps the object's storage)
+    };
+    struct chunk
+    {
+        char *memory;
+        int nslots;
+    };
+    static const size_t HEADER = sizeof(pool*);     // the physics holds nothing that needs more than 8 byte alignment
+    size_t slotsize;
+    int chunkslots;
+    std::vector<chunk> chunks;  // runs get a chunk each, of just their size
+    int nslots;                 // over all chunks
+    slot *freelist;
+    int nlive;
+    tthread::mutex m;
+    void grow();                // (these three are called with the lock held)
+    char *addChunk(int n);
+    void freeChunk(const chunk &c);
+public:
+    // Slots side by side in a chunk of their own, all counted as live from the start, so whoever claimed
+    // them can place an object in each without going near the lock or the free list. Once made, the
+    // objects are freed like any other.
+    struct run
+    {
+        char *first;
+        size_t slotsize;
+        run();
+        void *operator[](int i) const;  // storage for the i'th object
+    };
+    // A byte for byte copy of every chunk, live slots and free list alike. Putting it back returns each
+    // slot to exactly the object (or free link) it held, at the same address, so pointers between the
+    // objects come back valid too.
+    struct image
+    {
+        std::vector<char> bytes;
+        slot *freelist;
+        int nlive;
+        int nchunks;
+    };
+    pool(size_t _objectsize, int _chunkslots = 4096);
+    ~pool();                // same as release()
+    void *allocate();
+    static void free(void *object);     // back to whichever pool it came from
+    run claim(int n);
+    void release();         // drop every chunk at once; anything still live is forgotten, not destroyed
+    void save(image &img);
+    bool restore(const image &img); // anything made since is forgotten, as for release(); false if chunks were released since
+    int getNLive();
+    size_t getNBytes();     // held from the heap, live or not
+};
+
+#endif // _POOL_H_
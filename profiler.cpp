@@ -0,0 +1,107 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include "timer.h"
+#include "tinythread.h"
+
+profiler::section::section(std::string _name)
+{
+    name = _name;
+    current = 0;
+    nframes = 0;
+}
+
+double profiler::section::mean()
+{
+    int n = std::min(nframes, HISTORY);
+    double total = 0;
+    for (int i = 0; i < n; i++)
+        total += history[i];
+    return n ? total / n : 0;
+}
+
+double profiler::section::percentile(double p)
+{
+    int n = std::min(nframes, HISTORY);
+    if (!n)
+        return 0;
+    std::vector<double> sorted(history, history + n);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[std::min((int)(p / 100 * n), n - 1)];
+}
+
+double profiler::section::max()
+{
+    int n = std::min(nframes, HISTORY);
+    return n ? *std::max_element(history, history + n) : 0;
+}
+
+profiler::scope::scope(section *_sect)
+{
+    sect = _sect;
+    start = timer::now();
+}
+
+profiler::scope::~scope()
+{
+    sect->current += timer::now() - start;
+}
+
+// Sections may be first used from the pipeline thread and the main thread at once
+tthread::mutex &sectionsLock()
+{
+    static tthread::mutex creating;
+    return creating;
+}
+
+std::vector<profiler::section*> &profiler::getSections()
+{
+    static std::vector<section*> sections;
+    return sections;
+}
+
+// A new section can move the list while it's being walked, but never moves or frees the sections themselves
+std::vector<profiler::section*> profiler::copySections()
+{
+    tthread::lock_guard<tthread::mutex> guard(sectionsLock());
+    return getSections();
+}
+
+profiler::section *profiler::getSection(std::string name)
+{
+    tthread::lock_guard<tthread::mutex> guard(sectionsLock());
+    std::vector<section*> &sections = getSections();
+    for (unsigned int i = 0; i < sections.size(); i++)
+        if (sections[i]->name == name)
+            return sections[i];
+    sections.push_back(new section(name));
+    return sections.back();
+}
+
+void profiler::endFrame()
+{
+    std::vector<section*> &sections = getSections();
+    for (unsigned int i = 0; i < sections.size(); i++)
+    {
+        sections[i]->history[sections[i]->nframes % HISTORY] = sections[i]->current;
+        sections[i]->nframes++;
+        sections[i]->current = 0;
+    }
+}
+
+bool profiler::writeCSV(std::string filename)
+{
+    std::ofstream file(filename.c_str());
+    if (!file.is_open())
+        return false;
+    std::vector<section*> &sections = getSections();
+    file << "section,frames,mean_ms,p50_ms,p99_ms,max_ms\n";
+    for (unsigned int i = 0; i < sections.size(); i++)
+    {
+        section *s = sections[i];
+        file << s->name << "," << std::min(s->nframes, HISTORY) << "," << s->mean() * 1000 << "," << s->percentile(50) * 1000
+             << "," << s->percentile(99) * 1000 << "," << s->max() * 1000 << "\n";
+    }
+    return true;
+}
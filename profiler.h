@@ -0,0 +1,53 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <string>
+#include <vector>
+
+// Scoped timers for the hot paths. Build with -DPROFILING to turn them on; otherwise PROFILE_SCOPE
+// expands to nothing. Each section accumulates its time over a frame, and endFrame() moves the total
+// into a rolling history. A section must only be timed by one thread at a time (so not inside
+// scheduler tasks), but different threads may time different sections - the pipelined game steps
+// the world on its own thread while the main thread draws. Call endFrame() when both are idle.
+namespace profiler
+{
+    const int HISTORY = 256;    // frames kept for the rolling statistics
+
+    struct section
+    {
+        std::string name;
+        double current;         // seconds so far this frame
+        double history[HISTORY];
+        int nframes;            // frames recorded so far (history wraps around)
+        section(std::string _name);
+        double mean();
+        double percentile(double p);
+        double max();
+    };
+
+    struct scope
+    {
+        section *sect;
+        double start;
+        scope(section *_sect);
+        ~scope();
+    };
+
+    section *getSection(std::string name);      // created on first use, kept in order of creation
+    std::vector<section*> &getSections();       // only while no other thread can be creating one (see endFrame)
+    std::vector<section*> copySections();       // safe at any time, e.g. for drawing while a step runs
+    void endFrame();
+    bool writeCSV(std::string filename);
+}
+
+#ifdef PROFILING
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) \
+    static profiler::section *PROFILE_CONCAT(profileSection, __LINE__) = profiler::getSection(name); \
+    profiler::scope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileSection, __LINE__))
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+#endif // _PROFILER_H_
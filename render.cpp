@@ -1,6 +1,14 @@
 #include "render.h"
 
 #include<GL/gl.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include "phys.h"
+#include "profiler.h"
 
 void render::triangle(vec2 a, vec2 b, vec2 c)
 {
@@ -38,3 +46,400 @@ void render::setColour(vec3f c)
 {
     glColor3f(c.x, c.y, c.z);
 }
+
+// 3x5 pixel font for on-screen text, one glyph per 15 bits (top row in the high bits).
+// Anything not listed (including space) draws as blank; lower case is drawn as upper case.
+const char glyphChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-/%()_";
+const unsigned short glyphBits[] = {
+    0x7B6F, 0x2C97, 0x73E7, 0x73CF, 0x5BC9, 0x79CF, 0x79EF, 0x7249,
+    0x7BEF, 0x7BCF, 0x2BED, 0x6BAE, 0x3923, 0x6B6E, 0x79A7, 0x79A4,
+    0x396B, 0x5BED, 0x7497, 0x126A, 0x5BAD, 0x4927, 0x5FED, 0x6B6D,
+    0x2B6A, 0x6BA4, 0x2B73, 0x6BAD, 0x388E, 0x7492, 0x5B6F, 0x5B6A,
+    0x5BFD, 0x5AAD, 0x5A92, 0x72A7, 0x0002, 0x0410, 0x01C0, 0x12A4,
+    0x52A5, 0x2922, 0x224A, 0x0007,
+};
+
+void render::text(float x, float y, float pixelsize, std::string str)
+{
+    glBegin(GL_QUADS);
+    for (unsigned int i = 0; i < str.length(); i++, x += pixelsize * 4)
+    {
+        const char *glyph = strchr(glyphChars, toupper(str[i]));
+        if (!glyph || !*glyph)
+            continue;
+        unsigned short bits = glyphBits[glyph - glyphChars];
+        for (int row = 0; row < 5; row++)
+            for (int col = 0; col < 3; col++)
+                if (bits & (1 << (14 - row * 3 - col)))
+                {
+                    glVertex2f(x + col * pixelsize, y + row * pixelsize);
+                    glVertex2f(x + (col + 1) * pixelsize, y + row * pixelsize);
+                    glVertex2f(x + (col + 1) * pixelsize, y + (row + 1) * pixelsize);
+                    glVertex2f(x + col * pixelsize, y + (row + 1) * pixelsize);
+                }
+    }
+    glEnd();
+}
+
+// Table of the profiler's rolling statistics, in the top left corner of the window
+void render::profileOverlay(int canvaswidth, int canvasheight)
+{
+    std::vector<profiler::section*> sections = profiler::copySections();     // a step may be adding sections as we draw
+    if (sections.empty())
+        return;
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, canvaswidth, canvasheight, 0, -1, 1);    // y down, in pixels
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    const float pixelsize = 2, lineheight = 14;
+    glColor4f(0, 0, 0, 0.6f);
+    glBegin(GL_QUADS);
+    glVertex2f(0, 0);
+    glVertex2f(380, 0);
+    glVertex2f(380, 20 + lineheight * (sections.size() + 1));
+    glVertex2f(0, 20 + lineheight * (sections.size() + 1));
+    glEnd();
+    glColor3f(1, 1, 1);
+    text(10, 10, pixelsize, "SECTION             MEAN     P50     P99  MS");
+    for (unsigned int i = 0; i < sections.size(); i++)
+    {
+        profiler::section *s = sections[i];
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2) << std::left << std::setw(16) << s->name.substr(0, 16) << std::right
+           << std::setw(8) << s->mean() * 1000 << std::setw(8) << s->percentile(50) * 1000 << std::setw(8) << s->percentile(99) * 1000;
+        float y = 10 + lineheight * (i + 1);
+        // A bar under each line showing the mean against a 60 FPS frame
+        glColor4f(0.2f, 0.5f, 1, 0.8f);
+        glBegin(GL_QUADS);
+        glVertex2f(10, y + 11);
+        glVertex2f(10 + 360 * std::min(s->mean() * 60, 1.0), y + 11);
+        glVertex2f(10 + 360 * std::min(s->mean() * 60, 1.0), y + 12);
+        glVertex2f(10, y + 12);
+        glEnd();
+        glColor3f(1, 1, 1);
+        text(10, y, pixelsize, ss.str());
+    }
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+void render::vertexArray::clear()
+{
+    positions.clear();
+    colours.clear();
+}
+
+void render::vertexArray::add(vec2 pos, vec3f colour)
+{
+    positions.push_back(pos.x);
+    positions.push_back(pos.y);
+    positions.push_back(-1);
+    colours.push_back(colour.x);
+    colours.push_back(colour.y);
+    colours.push_back(colour.z);
+}
+
+unsigned int render::vertexArray::size() const
+{
+    return positions.size() / 3;
+}
+
+void render::vertexArray::draw(unsigned int mode, bool withColours) const
+{
+    if (positions.empty())
+        return;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, &positions[0]);
+    if (withColours)
+    {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(3, GL_FLOAT, 0, &colours[0]);
+    }
+    glDrawArrays(mode, 0, size());
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void render::vertexArray::draw(unsigned int mode, const std::vector<unsigned int> &indices, bool withColours) const
+{
+    if (positions.empty() || indices.empty())
+        return;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, &positions[0]);
+    if (withColours)
+    {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(3, GL_FLOAT, 0, &colours[0]);
+    }
+    glDrawElements(mode, indices.size(), GL_UNSIGNED_INT, &indices[0]);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// Drawing for the physics objects lives here rather than in phys.cpp, so the simulation can be built without GL.
+
+void phys::world::render(double left, double right, double bottom, double top, const snapshot *s)
+{
+    // Without a snapshot from the caller, take one now (unless we're drawing object by object)
+    static snapshot live;
+    if (!s && !immediatemode)
+    {
+        capture(live, AABB(vec2(left, bottom), vec2(right, top)));
+        s = &live;
+    }
+    float t = s ? s->time : time;
+    // Draw the ocean floor
+    renderLand(left, right, bottom, top);
+    if (quickwaterfix)
+        renderWater(left, right, bottom, top, t);
+    // Draw all the points and springs
+    if (s)
+        renderSnapshot(*s);
+    else
+        renderObjectsImmediate();
+    if (!quickwaterfix)
+        renderWater(left, right, bottom, top, t);
+    glBegin(GL_LINES);
+    glLineWidth(1.f);
+    glEnd();
+    //buildBVHTree(true, points, collisionTree);
+}
+
+// Old path: a glBegin/glEnd pair for every object. Kept as a fallback for drivers that misbehave with vertex arrays.
+void phys::world::renderObjectsImmediate()
+{
+    {
+        PROFILE_SCOPE("render: points");
+        for (unsigned int i = 0; i < points.size(); i++)
+            points[i]->render();
+    }
+    {
+        PROFILE_SCOPE("render: springs");
+        for (unsigned int i = 0; i < springs.size(); i++)
+            springs[i]->render();
+    }
+    if (!xraymode)
+    {
+        PROFILE_SCOPE("render: ships");
+        for (unsigned int i = 0; i < ships.size(); i++)
+            ships[i]->render();
+    }
+    if (showstress)
+    {
+        PROFILE_SCOPE("render: stress");
+        for (unsigned int i = 0; i < springs.size(); i++)
+            if (springs[i]->isStressed(strains[i]))
+                springs[i]->render(true);
+    }
+}
+
+// Green when slack, through yellow, to red at the point of breaking
+vec3f strainColour(float fraction)
+{
+    if (fraction < 0)
+        fraction = 0;
+    if (fraction > 1)
+        fraction = 1;
+    return fraction < 0.5 ? vec3f(fraction * 2, 1, 0) : vec3f(1, 2 - fraction * 2, 0);
+}
+
+phys::snapshot::snapshot()
+{
+    time = 0;
+}
+
+// Fill one vertex array per layer. The points' array is shared by every layer that draws at point
+// positions (leaks, triangles, stress), which index into it. Clearing keeps the arrays' storage, so
+// recapturing into the same snapshot doesn't allocate. No GL calls here: this may run off the GL thread.
+// Only what can be seen is captured. The points were built row by row, so runs of consecutive points
+// are mostly close together: each run's bounds are checked against the view, and a run out of view
+// costs a min/max pass rather than the colours and vertices. Springs and triangles are kept if they
+// touch a captured point. The view is padded by a little more than a spring's length, so anything
+// crossing the edge of the screen has all its points captured.
+void phys::world::capture(snapshot &s, const AABB &view)
+{
+    PROFILE_SCOPE("render: fill");
+    const unsigned int TILE = 64;   // points per culling run
+    const float margin = 2;
+    AABB padded(view.bottomleft - vec2(margin, margin), view.topright + vec2(margin, margin));
+    s.time = time;
+    s.points.clear();
+    s.leaks.clear();
+    for (unsigned int first = 0; first < points.size(); first += TILE)
+    {
+        unsigned int last = std::min(first + TILE, (unsigned int)points.size());
+        AABB bounds(points[first]->pos, points[first]->pos);
+        for (unsigned int i = first + 1; i < last; i++)
+            bounds.extendTo(AABB(points[i]->pos, points[i]->pos));
+        if (!bounds.intersects(padded))
+        {
+            for (unsigned int i = first; i < last; i++)
+                points[i]->index = -1;
+            continue;
+        }
+        for (unsigned int i = first; i < last; i++)
+        {
+            point *p = points[i];
+            p->index = s.points.size();
+            s.points.add(p->pos, p->colour);
+            if (p->isLeaking)
+                s.leaks.push_back(p->index);
+        }
+    }
+    s.springs.clear();
+    s.stress.clear();
+    for (unsigned int i = 0; i < springs.size(); i++)
+    {
+        spring *sp = springs[i];
+        if (sp->a->index < 0 && sp->b->index < 0)
+            continue;
+        if (stressmap)
+        {
+            vec3f colour = strainColour((strains[i] - 1) / sp->getStrength());
+            s.springs.add(sp->a->pos, colour);
+            s.springs.add(sp->b->pos, colour);
+        }
+        else
+        {
+            s.springs.add(sp->a->pos, sp->getColour(sp->a));
+            s.springs.add(sp->b->pos, sp->getColour(sp->b));
+        }
+        if (showstress && sp->a->index >= 0 && sp->b->index >= 0 && sp->isStressed(strains[i]))
+        {
+            s.stress.push_back(sp->a->index);
+            s.stress.push_back(sp->b->index);
+        }
+    }
+    s.triangles.clear();
+    if (!xraymode)
+        for (unsigned int i = 0; i < ships.size(); i++)
+            for (unsigned int j = 0; j < ships[i]->triangles.size(); j++)
+            {
+                const ship::triangle &tri = ships[i]->triangles[j];
+                if (tri.a->index < 0 || tri.b->index < 0 || tri.c->index < 0)
+                    continue;
+                s.triangles.push_back(tri.a->index);
+                s.triangles.push_back(tri.b->index);
+                s.triangles.push_back(tri.c->index);
+            }
+}
+
+// Draw each layer of a snapshot with a single call.
+void phys::world::renderSnapshot(const snapshot &s)
+{
+    {
+        PROFILE_SCOPE("render: points");
+        glColor3f(0, 0, 1);
+        s.points.draw(GL_POINTS, s.leaks, false);
+    }
+    {
+        PROFILE_SCOPE("render: springs");
+        s.springs.draw(GL_LINES);
+    }
+    {
+        PROFILE_SCOPE("render: ships");
+        s.points.draw(GL_TRIANGLES, s.triangles);
+    }
+    {
+        PROFILE_SCOPE("render: stress");
+        glColor3f(1, 0, 0);
+        s.points.draw(GL_LINES, s.stress, false);
+    }
+}
+
+// The sea and the seabed are each one strip of columns, from the surface down to the bottom of the view.
+// Columns are narrow enough to follow the surface's shortest wave, but no narrower than a few pixels'
+// worth of a 1024-wide view, so they stay cheap zoomed out and smooth zoomed in. They start on a multiple
+// of the column width, so they don't crawl along the surface as the view pans.
+void surfaceColumns(double left, double right, float wavelength, double &first, double &width, int &count)
+{
+    const int perWave = 16, maxColumns = 256;
+    width = std::max((double)wavelength / perWave, (right - left) / maxColumns);
+    first = floor(left / width) * width;
+    count = (int)ceil((right - first) / width);
+}
+
+void phys::world::renderLand(double left, double right, double bottom, double top)
+{
+    PROFILE_SCOPE("render: land");
+    static render::vertexArray strip;
+    double first, width;
+    int count;
+    surfaceColumns(left, right, 420, first, width, count);     // shortest wave in oceanfloorheight is 2pi / 0.015
+    strip.clear();
+    for (int i = 0; i <= count; i++)
+    {
+        float x = first + i * width;
+        strip.add(vec2(x, oceanfloorheight(x)), vec3f(0, 0, 0));
+        strip.add(vec2(x, bottom), vec3f(0, 0, 0));
+    }
+    glColor4f(0.5, 0.5, 0.5, 1);
+    strip.draw(GL_TRIANGLE_STRIP, false);
+}
+
+void phys::world::renderWater(double left, double right, double bottom, double top, float t)
+{
+    PROFILE_SCOPE("render: water");
+    static render::vertexArray strip;
+    double first, width;
+    int count;
+    surfaceColumns(left, right, 21, first, width, count);      // shortest wave in waterheight is 2pi / 0.3
+    strip.clear();
+    for (int i = 0; i <= count; i++)
+    {
+        float x = first + i * width;
+        strip.add(vec2(x, waterheight(x, t)), vec3f(0, 0, 0));
+        strip.add(vec2(x, bottom), vec3f(0, 0, 0));
+    }
+    glColor4f(0, 0.25, 1, 0.5);
+    strip.draw(GL_TRIANGLE_STRIP, false);
+}
+
+void phys::point::render()
+{
+    // Put a blue blob on leaking nodes (was more for debug purposes, but looks better IMO)
+    if (isLeaking)
+    {
+        glColor3f(0, 0, 1);
+        glBegin(GL_POINTS);
+        glVertex3f(pos.x, pos.y, -1);
+        glEnd();
+    }
+}
+
+void phys::spring::render(bool showStress)
+{
+    // If member is heavily stressed, highlight it in red (ignored if world's showstress field is false)
+    glBegin(GL_LINES);
+    if (showStress)
+        glColor3f(1, 0, 0);
+    else
+        render::setColour(getColour(a));
+    glVertex3f(a->pos.x, a->pos.y, -1);
+    if (!showStress)
+        render::setColour(getColour(b));
+    glVertex3f(b->pos.x, b->pos.y, -1);
+    glEnd();
+}
+
+void phys::ship::render()
+{
+    for (unsigned int i = 0; i < triangles.size(); i++)
+    {
+        const triangle &t = triangles[i];
+        render::triangle(t.a->pos, t.b->pos, t.c->pos, t.a->colour, t.b->colour, t.c->colour);
+    }
+}
+
+void phys::AABB::render()
+{
+    render::box(bottomleft, topright);
+}
+
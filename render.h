@@ -1,6 +1,8 @@
 #ifndef _RENDER_H_
 #define _RENDER_H_
 
+#include <string>
+#include <vector>
 #include "vec.h"
 
 namespace render
@@ -9,6 +11,21 @@ namespace render
     void triangle(vec2 posa, vec2 posb, vec2 posc, vec3f cola, vec3f colb, vec3f colc);
     void box(vec2 bottomleft, vec2 topright);
     void setColour(vec3f c);
+    void text(float x, float y, float pixelsize, std::string str);   // screen space, y down
+    void profileOverlay(int canvaswidth, int canvasheight);
+
+    // Positions and colours for a whole layer, drawn from client memory with a single call.
+    // Clearing keeps the storage, so refilling it each frame doesn't allocate.
+    struct vertexArray
+    {
+        std::vector<float> positions;   // x, y, z
+        std::vector<float> colours;     // r, g, b
+        void clear();
+        void add(vec2 pos, vec3f colour);
+        unsigned int size() const;
+        void draw(unsigned int mode, bool withColours = true) const;   // every vertex, in order
+        void draw(unsigned int mode, const std::vector<unsigned int> &indices, bool withColours = true) const;
+    };
 }
 
 #endif // _RENDER_H_
@@ -1,39 +1,157 @@
 #include "scheduler.h"
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
-// scheduler
+#include <map>
+#include <sstream>
+#include "timer.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
-scheduler::scheduler()
+#ifdef __linux__
+int readTopology(int cpu, std::string field)
 {
-    nthreads = tthread::thread::hardware_concurrency();
-    for (int i = 0; i < nthreads; i++)
+    std::stringstream path;
+    path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/" << field;
+    std::ifstream file(path.str().c_str());
+    int value = 0;
+    file >> value;
+    return value;
+}
+
+struct cpuPlace
+{
+    int sibling, package, core, cpu;    // sibling: 0 for the first hardware thread of a core, 1 for the next...
+    bool operator<(const cpuPlace &rhs) const
     {
-        threadPool.push_back(new thread(this));
-        threadPool[i]->name = i;
+        if (sibling != rhs.sibling)
+            return sibling < rhs.sibling;
+        if (package != rhs.package)
+            return package < rhs.package;
+        if (core != rhs.core)
+            return core < rhs.core;
+        return cpu < rhs.cpu;
     }
+};
+
+// The CPUs this process may run on, in the order workers are placed on them: one hardware thread of
+// each physical core, a socket at a time, and only then the cores' second hardware threads. Workers
+// next to each other in the list (and so neighbouring slabs of springs) share a socket's cache.
+std::vector<int> workerCPUs()
+{
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return cpus;
+    std::vector<cpuPlace> places;
+    std::map<std::pair<int, int>, int> siblings;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        cpuPlace p;
+        p.cpu = cpu;
+        p.package = readTopology(cpu, "physical_package_id");
+        p.core = readTopology(cpu, "core_id");
+        p.sibling = siblings[std::make_pair(p.package, p.core)]++;
+        places.push_back(p);
+    }
+    std::sort(places.begin(), places.end());
+    for (unsigned int i = 0; i < places.size(); i++)
+        cpus.push_back(places[i].cpu);
+    return cpus;
+}
+#endif
+
+// scheduler
+
+scheduler::scheduler(int _nthreads, bool _pin)
+{
+    outstanding = 0;
+    stopping = false;
+    tracing = false;
+    tracestart = 0;
+    nthreads = _nthreads > 0 ? _nthreads : tthread::thread::hardware_concurrency();
+    if (nthreads < 1)
+        nthreads = 1;
+    std::vector<int> cpus;
+#ifdef __linux__
+    if (_pin)
+        cpus = workerCPUs();
+#endif
+    for (int i = 0; i < nthreads; i++)
+        threadPool.push_back(new thread(this, i, cpus.empty() ? -1 : cpus[i % cpus.size()]));
 }
 
 scheduler::~scheduler()
 {
-    /*for (unsigned int i = 0; i < threadPool.size(); i++)
-        threadPool[i];*/
+    // Wake every worker with nothing to do, so they all see the flag and exit, then wait for them
+    critical.lock();
+    stopping = true;
+    for (unsigned int i = 0; i < threadPool.size(); i++)
+        threadPool[i]->wake.notify_one();
+    critical.unlock();
+    for (unsigned int i = 0; i < threadPool.size(); i++)
+        delete threadPool[i];
 }
 
-void scheduler::schedule(task *t)
+// A task for a particular worker goes on that worker's own queue; anything else goes on the shared
+// queue, and wakes one sleeping worker if there is one (if not, a busy one will pick it up next).
+void scheduler::schedule(task *t, int worker)
 {
     critical.lock();
-    tasks.push(t);
-    available.signal();
+    double lockstart = timer::now();
+    thread *target = 0;
+    unsigned int depth;
+    if (worker >= 0)
+    {
+        thread *owner = threadPool[worker % nthreads];
+        owner->own.push(t);
+        depth = owner->own.size();
+        if (owner->sleeping)
+            target = owner;
+    }
+    else
+    {
+        tasks.push(t);
+        depth = tasks.size();
+        for (unsigned int i = 0; i < threadPool.size() && !target; i++)
+            if (threadPool[i]->sleeping)
+                target = threadPool[i];
+    }
+    outstanding++;
+    if (depth > counters.maxQueueDepth)
+        counters.maxQueueDepth = depth;
+    if (target)
+    {
+        target->sleeping = false;   // so the next shared task wakes someone else
+        target->wake.notify_one();
+    }
+    counters.scheduleLocked += timer::now() - lockstart;
     critical.unlock();
 }
 
 void scheduler::wait()
 {
+    // Count everything scheduled, not just what is still queued - a task which has
+    // already been picked up by a worker may not have finished yet.
     critical.lock();
-    int tasksleft = tasks.size();
+    int tasksleft = outstanding;
+    outstanding = 0;
     critical.unlock();
+    double start = timer::now();
     for (int i = 0; i < tasksleft; i++)
         completed.wait();
+    double end = timer::now();
+    counters.barrierTime += end - start;
+    if (end - start > counters.maxBarrier)
+        counters.maxBarrier = end - start;
+    counters.barriers++;
+    if (tracing)
+        mainTrace.record("barrier", start, end);
 }
 
 int scheduler::getNThreads()
@@ -41,6 +159,79 @@ int scheduler::getNThreads()
     return nthreads;
 }
 
+int scheduler::getCPU(int worker)
+{
+    return threadPool[worker % nthreads]->cpu;
+}
+
+scheduler::stats scheduler::getStats()
+{
+    stats result = counters;
+    for (unsigned int i = 0; i < threadPool.size(); i++)
+        result.threads.push_back(threadPool[i]->counters);
+    return result;
+}
+
+void scheduler::resetStats()
+{
+    counters = stats();
+    for (unsigned int i = 0; i < threadPool.size(); i++)
+        threadPool[i]->counters = stats::threadStats();
+}
+
+void scheduler::setTracing(bool on)
+{
+    if (on && !tracing)
+    {
+        tracestart = timer::now();
+        mainTrace = traceBuffer();
+        for (unsigned int i = 0; i < threadPool.size(); i++)
+            threadPool[i]->trace = traceBuffer();
+    }
+    tracing = on;
+}
+
+bool scheduler::writeTrace(std::string filename)
+{
+    std::ofstream file(filename.c_str());
+    if (!file.is_open())
+        return false;
+    file << "{\"traceEvents\": [\n";
+    file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"main\"}}";
+    for (unsigned int i = 0; i < threadPool.size(); i++)
+        file << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << i + 1
+             << ", \"args\": {\"name\": \"worker " << i << "\"}}";
+    file.precision(3);
+    file << std::fixed;
+    for (unsigned int t = 0; t <= threadPool.size(); t++)
+    {
+        traceBuffer &trace = t == 0 ? mainTrace : threadPool[t - 1]->trace;
+        unsigned int first = trace.count > (unsigned int)traceBuffer::SIZE ? trace.count - traceBuffer::SIZE : 0;
+        for (unsigned int i = first; i < trace.count; i++)
+        {
+            traceBuffer::event &e = trace.events[i % traceBuffer::SIZE];
+            // Complete ("X") events, with times in microseconds from when tracing started
+            file << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << t
+                 << ", \"ts\": " << (e.begin - tracestart) * 1e6 << ", \"dur\": " << (e.end - e.begin) * 1e6 << "}";
+        }
+    }
+    file << "\n]}\n";
+    return true;
+}
+
+// scheduler::traceBuffer
+
+void scheduler::traceBuffer::record(const char *name, double begin, double end)
+{
+    if (events.empty())
+        events.resize(SIZE);
+    event &e = events[count % SIZE];
+    e.name = name;
+    e.begin = begin;
+    e.end = end;
+    count++;
+}
+
 // scheduler::semaphore
 
 void scheduler::semaphore::signal()
@@ -60,10 +251,33 @@ void scheduler::semaphore::wait()
 
 // scheduler::thread
 
-scheduler::thread::thread(scheduler *_parent): tthread::thread(scheduler::thread::enter, this)
+scheduler::thread::thread(scheduler *_parent, int _name, int _cpu)
 {
     parent = _parent;
-    detach();
+    name = _name;
+    cpu = _cpu;
+    sleeping = false;
+    currentTask = 0;
+    handle = new tthread::thread(scheduler::thread::enter, this);
+#ifdef __linux__
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(handle->native_handle(), sizeof(set), &set) != 0)
+        {
+            std::cout << "Error: could not pin worker " << name << " to CPU " << cpu << "\n";
+            cpu = -1;
+        }
+    }
+#endif
+}
+
+scheduler::thread::~thread()
+{
+    handle->join();
+    delete handle;
 }
 
 void scheduler::thread::enter(void *arg)
@@ -72,13 +286,46 @@ void scheduler::thread::enter(void *arg)
     while (true)
     {
         //parent->critical.lock(); std::cout << "Thread " << name << " ready.\n"; parent->critical.unlock();
-        _this->parent->available.wait();
+        double waitstart = timer::now();
         _this->parent->critical.lock();
-        _this->currentTask = _this->parent->tasks.front();
-        _this->parent->tasks.pop();
+        while (_this->own.empty() && _this->parent->tasks.empty() && !_this->parent->stopping)
+        {
+            _this->sleeping = true;
+            _this->wake.wait(_this->parent->critical);
+            _this->sleeping = false;
+        }
+        double dequeuestart = timer::now();
+        if (!_this->own.empty())
+        {
+            _this->currentTask = _this->own.front();
+            _this->own.pop();
+        }
+        else if (!_this->parent->tasks.empty())
+        {
+            _this->currentTask = _this->parent->tasks.front();
+            _this->parent->tasks.pop();
+        }
+        else
+        {
+            _this->parent->critical.unlock();   // stopping, and nothing left to do
+            return;
+        }
         _this->parent->critical.unlock();
         //parent->critical.lock(); std::cout << "Thread " << name << " starting task.\n"; parent->critical.unlock();
+        double taskstart = timer::now();
         _this->currentTask->process();
+        double taskend = timer::now();
+        _this->counters.waiting += dequeuestart - waitstart;
+        _this->counters.locked += taskstart - dequeuestart;
+        _this->counters.working += taskend - taskstart;
+        _this->counters.tasks++;
+        if (_this->parent->tracing)
+        {
+            // "dequeue" is the time spent taking the task off its queue (this worker's own first, then the shared one)
+            _this->trace.record("wait", waitstart, dequeuestart);
+            _this->trace.record("dequeue", dequeuestart, taskstart);
+            _this->trace.record(_this->currentTask->getName(), taskstart, taskend);
+        }
         delete _this->currentTask;
         _this->parent->completed.signal();
         //parent->critical.lock(); std::cout << "Thread " << name << " finished.\n"; parent->critical.unlock();
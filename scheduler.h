@@ -2,6 +2,8 @@
 #define _SCHEDULER_H_
 
 #include <queue>
+#include <string>
+#include <vector>
 #include "tinythread.h"
 
 class scheduler
@@ -10,16 +12,61 @@ public:
     struct task
     {
         virtual void process() = 0;
+        virtual const char *getName() {return "task";}     // label in traces
         virtual ~task() {}
     };
+    // Where the time went, to tell a compute-bound frame from one stuck in synchronisation.
+    // Times are in seconds, accumulated since construction or the last resetStats().
+    struct stats
+    {
+        struct threadStats
+        {
+            double waiting;         // asleep (or after the lock) until a task arrived
+            double locked;          // holding the queue lock
+            double working;         // inside task::process
+            unsigned long tasks;
+            threadStats(): waiting(0), locked(0), working(0), tasks(0) {}
+        };
+        std::vector<threadStats> threads;
+        double scheduleLocked;      // holding the queue lock in schedule()
+        double barrierTime;         // in wait(), until the last task completed
+        double maxBarrier;
+        unsigned long barriers;
+        unsigned int maxQueueDepth;
+        stats(): scheduleLocked(0), barrierTime(0), maxBarrier(0), barriers(0), maxQueueDepth(0) {}
+    };
 private:
-    class thread: public tthread::thread
+    // Fixed-size ring of timed events, keeping the most recent. Only its own thread ever records into it,
+    // and it is only read while the scheduler is idle (after wait()), so recording takes no lock.
+    class traceBuffer
+    {
+    public:
+        struct event
+        {
+            const char *name;
+            double begin, end;
+        };
+        static const int SIZE = 1 << 16;
+        std::vector<event> events;
+        unsigned int count;     // events ever recorded
+        traceBuffer(): count(0) {}
+        void record(const char *name, double begin, double end);
+    };
+    class thread
     {
         scheduler *parent;
         task *currentTask;
+        tthread::thread *handle;    // started only once parent and name are set, so the worker never sees them uninitialised
     public:
         int name;
-        thread(scheduler *_parent);
+        int cpu;                    // pinned to this CPU, or -1 if free to move
+        std::queue<task*> own;      // tasks for this worker only; it takes these before any shared ones
+        tthread::condition_variable wake;   // (waited on with the scheduler's lock)
+        bool sleeping;              // waiting on wake, and not yet told to get up
+        traceBuffer trace;
+        stats::threadStats counters;    // written only by this worker
+        thread(scheduler *_parent, int _name, int _cpu);
+        ~thread();
         static void enter(void *_this);
     };
     class semaphore
@@ -34,16 +81,26 @@ private:
     };
     int nthreads;
     std::vector <thread*> threadPool;
-    semaphore available;
     semaphore completed;
-    std::queue<task*> tasks;
+    std::queue<task*> tasks;    // for whichever worker is free first
+    int outstanding;    // tasks scheduled since the last wait(), whether queued or already running
+    bool stopping;      // set by the destructor: workers exit once the queue is empty
     tthread::mutex critical;
+    bool tracing;
+    double tracestart;
+    traceBuffer mainTrace;  // barrier waits, recorded by whichever thread calls wait()
+    stats counters;         // the scheduling thread's share; workers keep their own
 public:
-    scheduler();
+    scheduler(int _nthreads = 0, bool _pin = false);   // 0 => one thread per hardware thread; pin => each worker stays on one CPU (Linux only)
     ~scheduler();
-    void schedule(task *t);
+    void schedule(task *t, int worker = -1);    // worker >= 0 => always run on that worker (mod the worker count), so its cache stays warm for it
     void wait();
     int getNThreads();
+    int getCPU(int worker);                 // -1 if not pinned
+    stats getStats();                       // only call while idle
+    void resetStats();
+    void setTracing(bool on);               // only change while idle
+    bool writeTrace(std::string filename);  // Chrome trace-event JSON (chrome://tracing, Perfetto); only call while idle
 };
 
 
@@ -0,0 +1,79 @@
+#include "shipgen.h"
+
+#include <cmath>
+
+shipgen::params::params()
+{
+    npoints = 10000;
+    hullratio = 0.25;
+    holedensity = 0.02;
+    seed = 1;
+}
+
+// Small LCG rather than rand(), so a given seed makes the same ship on every platform
+struct lcg
+{
+    unsigned int state;
+    lcg(unsigned int seed): state(seed) {}
+    unsigned int next()
+    {
+        state = state * 1103515245U + 12345U;
+        return (state >> 16) & 0x7FFF;
+    }
+    float uniform()
+    {
+        return next() / 32768.f;
+    }
+};
+
+// The hull is a box 4 times as wide as it is tall, with the sides curving in towards the keel:
+// row y spans [left(y), right(y)], with the inset growing quadratically towards the bottom.
+int hullInset(int y, int width, int height)
+{
+    float depth = 1.f - (float)y / height;
+    return (int)(width * 0.25f * depth * depth);
+}
+
+std::vector<material*> shipgen::generate(const params &p, int &width, int &height)
+{
+    // Area of the hull shape is 5/6 of its bounding box; holes take a bit more off
+    float area = p.npoints / (1.f - p.holedensity / (1.f + p.hullratio));
+    height = (int)ceilf(sqrtf(area / (4.f * 5.f / 6.f)));
+    if (height < 3)
+        height = 3;
+    width = height * 4;
+    // Thickness of the hull, so that (thickness * perimeter) hull points gives roughly the asked-for ratio
+    int thickness = (int)floorf(area * p.hullratio / (1.f + p.hullratio) / (2.f * (width + height)) + 0.5f);
+    if (thickness < 1)
+        thickness = 1;
+
+    lcg rng(p.seed);
+    int blocksx = (width + 7) / 8, blocksy = (height + 7) / 8;
+    std::vector<material*> hullblocks(blocksx * blocksy, (material*)0), interiorblocks(blocksx * blocksy, (material*)0);
+    for (int i = 0; i < blocksx * blocksy; i++)
+    {
+        if (p.hull.size())
+            hullblocks[i] = p.hull[rng.next() % p.hull.size()];
+        if (p.interior.size())
+            interiorblocks[i] = p.interior[rng.next() % p.interior.size()];
+    }
+
+    std::vector<material*> grid(width * height, (material*)0);
+    for (int y = 0; y < height; y++)
+    {
+        int inset = hullInset(y, width, height);
+        int insetbelow = hullInset(y - thickness, width, height);
+        for (int x = inset; x < width - inset; x++)
+        {
+            int block = x / 8 + (y / 8) * blocksx;
+            bool isHull = x - inset < thickness || width - 1 - inset - x < thickness ||     // sides
+                          y < thickness || y >= height - thickness ||                       // keel and deck
+                          x < insetbelow || x >= width - insetbelow;                        // curve of the keel
+            if (isHull)
+                grid[x + y * width] = hullblocks[block];
+            else if (rng.uniform() >= p.holedensity)
+                grid[x + y * width] = interiorblocks[block];
+        }
+    }
+    return grid;
+}
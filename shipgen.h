@@ -0,0 +1,25 @@
+#ifndef _SHIPGEN_H_
+#define _SHIPGEN_H_
+
+#include <vector>
+#include "material.h"
+
+// Procedural ships, for benchmarking at sizes nobody would draw by hand
+namespace shipgen
+{
+    struct params
+    {
+        int npoints;                        // roughly how many points the ship should have
+        float hullratio;                    // hull points per interior point
+        float holedensity;                  // fraction of the interior left empty
+        std::vector<material*> hull;        // hull materials, picked at random per 8x8 block
+        std::vector<material*> interior;    // interior materials, likewise
+        unsigned int seed;
+        params();
+    };
+
+    // Result is indexed [x + y * width] with y up, ready for phys::ship::build
+    std::vector<material*> generate(const params &p, int &width, int &height);
+}
+
+#endif // _SHIPGEN_H_
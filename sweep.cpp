@@ -0,0 +1,257 @@
+/***************************************************************
+ * Name:      sweep.cpp
+ * Purpose:   Runs one ship under many combinations of world
+ *            settings at once, one world per worker, and reports
+ *            when (and whether) each one sinks
+ * Usage:     sweep [ship.png] [-strength 0.005,0.01,...]
+ *                  [-buoyancy 4,...] [-waterpressure 0.3,...]
+ *                  [-waveheight 1,...] [-frames N] [-dt seconds]
+ *                  [-sunk fraction] [-jobs N] [-materials file.json]
+ *                  [-format csv|json] [-out file (default sweep.csv)]
+ **************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <IL/il.h>
+#include "material.h"
+#include "phys.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "tinythread.h"
+#include "util.h"
+
+const int LARGE_SHIP = 20000;   // nodes; ships this big also get threads of their own inside their world
+const int SAMPLE_FRAMES = 10;   // how often to check whether a world has sunk
+
+struct config
+{
+    float strength, buoyancy, waterpressure, waveheight;
+};
+
+struct result
+{
+    config cfg;
+    int points, springs;
+    double sinktime;        // simulated seconds, or -1 if it stayed up
+    float submerged;        // fraction of points under water at the end
+    double water;           // total over all points at the end
+    int broken;             // springs lost (no tools are used, so all of these broke)
+    int frames;             // actually simulated (a world stops once it has sunk)
+    double seconds;         // wall clock
+};
+
+// One whole run of one world. The worlds share nothing but the (read only) ship grid, so any number of these can run at once.
+struct worldTask: scheduler::task
+{
+    worldTask(const std::vector<material*> *_grid, int _width, int _height, config _cfg, int _nthreads,
+              int _nframes, double _dt, float _sunk, result *_out);
+    const std::vector<material*> *grid;
+    int width, height;
+    config cfg;
+    int nthreads, nframes;
+    double dt;
+    float sunk;
+    result *out;
+    virtual void process();
+    virtual const char *getName();
+};
+
+worldTask::worldTask(const std::vector<material*> *_grid, int _width, int _height, config _cfg, int _nthreads,
+                     int _nframes, double _dt, float _sunk, result *_out)
+{
+    grid = _grid;
+    width = _width;
+    height = _height;
+    cfg = _cfg;
+    nthreads = _nthreads;
+    nframes = _nframes;
+    dt = _dt;
+    sunk = _sunk;
+    out = _out;
+}
+
+void worldTask::process()
+{
+    double start = timer::now();
+    phys::world wld(vec2(0, -9.8), cfg.buoyancy, cfg.strength, nthreads);
+    wld.waterpressure = cfg.waterpressure;
+    wld.waveheight = cfg.waveheight;
+    phys::ship *shp = new phys::ship(&wld);
+    shp->build(*grid, width, height);
+
+    out->cfg = cfg;
+    out->points = wld.getNPoints();
+    out->springs = wld.getNSprings();
+    out->sinktime = -1;
+    out->frames = 0;
+    while (out->frames < nframes)
+    {
+        wld.update(dt);
+        out->frames++;
+        if (out->frames % SAMPLE_FRAMES == 0 && wld.getSubmergedFraction() >= sunk)
+        {
+            out->sinktime = out->frames * dt;
+            break;
+        }
+    }
+    out->submerged = wld.getSubmergedFraction();
+    out->water = wld.getTotalWater();
+    out->broken = out->springs - wld.getNSprings();
+    out->seconds = timer::now() - start;
+}
+
+const char *worldTask::getName()
+{
+    return "world";
+}
+
+bool loadGrid(const palette &colours, std::string filename, std::vector<material*> &grid, int &width, int &height)
+{
+    ILuint imghandle;
+    ilGenImages(1, &imghandle);
+    ilBindImage(imghandle);
+    if (!ilLoadImage((const ILstring)(filename.c_str())))
+    {
+        std::cout << "Error: could not load image \"" << filename << "\": " << ilGetError() << "\n";
+        ilDeleteImage(imghandle);
+        return false;
+    }
+    width = ilGetInteger(IL_IMAGE_WIDTH);
+    height = ilGetInteger(IL_IMAGE_HEIGHT);
+    grid = colours.classifyImage(ilGetData(), width, height);
+    ilDeleteImage(imghandle);
+    return true;
+}
+
+void writeReport(std::ostream &out, const std::vector<result> &results, std::string format)
+{
+    if (format == "json")
+        out << "[\n";
+    else
+        out << "strength,buoyancy,waterpressure,waveheight,points,springs,frames,sinktime,submerged,water,broken,seconds\n";
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const result &r = results[i];
+        if (format == "json")
+        {
+            out << (i ? ",\n" : "") << "  {\"strength\": " << r.cfg.strength << ", \"buoyancy\": " << r.cfg.buoyancy
+                << ", \"waterpressure\": " << r.cfg.waterpressure << ", \"waveheight\": " << r.cfg.waveheight
+                << ", \"points\": " << r.points << ", \"springs\": " << r.springs << ", \"frames\": " << r.frames
+                << ", \"sinktime\": " << r.sinktime << ", \"submerged\": " << r.submerged << ", \"water\": " << r.water
+                << ", \"broken\": " << r.broken << ", \"seconds\": " << r.seconds << "}";
+        }
+        else
+        {
+            out << r.cfg.strength << "," << r.cfg.buoyancy << "," << r.cfg.waterpressure << "," << r.cfg.waveheight
+                << "," << r.points << "," << r.springs << "," << r.frames << "," << r.sinktime << "," << r.submerged
+                << "," << r.water << "," << r.broken << "," << r.seconds << "\n";
+        }
+    }
+    if (format == "json")
+        out << "\n]\n";
+}
+
+int main(int argc, char **argv)
+{
+    std::string shipfile = "ship.png", materialfile = "data/materials.json", format = "csv", outfile;
+    std::string strengths = "0.01", buoyancies = "4", pressures = "0.3", waveheights = "1";
+    int nframes = 3000, njobs = 0;
+    double dt = 0.02;
+    float sunk = 0.95;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-strength" && i + 1 < argc)
+            strengths = argv[++i];
+        else if (arg == "-buoyancy" && i + 1 < argc)
+            buoyancies = argv[++i];
+        else if (arg == "-waterpressure" && i + 1 < argc)
+            pressures = argv[++i];
+        else if (arg == "-waveheight" && i + 1 < argc)
+            waveheights = argv[++i];
+        else if (arg == "-frames" && i + 1 < argc)
+            nframes = atoi(argv[++i]);
+        else if (arg == "-dt" && i + 1 < argc)
+            dt = atof(argv[++i]);
+        else if (arg == "-sunk" && i + 1 < argc)
+            sunk = atof(argv[++i]);
+        else if (arg == "-jobs" && i + 1 < argc)
+            njobs = atoi(argv[++i]);
+        else if (arg == "-materials" && i + 1 < argc)
+            materialfile = argv[++i];
+        else if (arg == "-format" && i + 1 < argc)
+            format = argv[++i];
+        else if (arg == "-out" && i + 1 < argc)
+            outfile = argv[++i];
+        else
+            shipfile = arg;
+    }
+
+    ilInit();
+    std::vector<material*> materials;
+    Json::Value matroot = jsonParseFile(materialfile);
+    for (unsigned int i = 0; i < matroot.size(); i++)
+        materials.push_back(new material(matroot[i]));
+    std::vector<material*> grid;
+    int width, height;
+    if (!loadGrid(palette(materials), shipfile, grid, width, height))
+        return 1;
+    int nodes = grid.size() - std::count(grid.begin(), grid.end(), (material*)0);
+
+    std::vector<config> configs;
+    std::vector<std::string> strengthlist = splitList(strengths), buoyancylist = splitList(buoyancies),
+                             pressurelist = splitList(pressures), wavelist = splitList(waveheights);
+    for (unsigned int s = 0; s < strengthlist.size(); s++)
+    for (unsigned int b = 0; b < buoyancylist.size(); b++)
+    for (unsigned int p = 0; p < pressurelist.size(); p++)
+    for (unsigned int w = 0; w < wavelist.size(); w++)
+    {
+        config cfg;
+        cfg.strength = atof(strengthlist[s].c_str());
+        cfg.buoyancy = atof(buoyancylist[b].c_str());
+        cfg.waterpressure = atof(pressurelist[p].c_str());
+        cfg.waveheight = atof(wavelist[w].c_str());
+        configs.push_back(cfg);
+    }
+
+    // Independent worlds scale far better than one world's spring passes, so the cores go to whole
+    // worlds first. Only a big ship, with cores left over, gets more than one thread inside its world.
+    int ncores = std::max(1, (int)tthread::thread::hardware_concurrency());
+    if (njobs <= 0)
+        njobs = std::min(ncores, (int)configs.size());
+    int worldthreads = nodes >= LARGE_SHIP ? std::max(1, ncores / njobs) : 1;
+    std::cout << "Running " << configs.size() << " worlds of " << nodes << " nodes, " << njobs << " at a time, "
+              << worldthreads << " thread(s) each\n";
+
+    std::vector<result> results(configs.size());
+    double start = timer::now();
+    {
+        scheduler runner(njobs);
+        for (unsigned int i = 0; i < configs.size(); i++)
+            runner.schedule(new worldTask(&grid, width, height, configs[i], worldthreads, nframes, dt, sunk, &results[i]));
+        runner.wait();
+    }
+    double elapsed = timer::now() - start;
+
+    int nsunk = 0;
+    double simulated = 0;
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        simulated += results[i].frames * dt;
+        if (results[i].sinktime >= 0)
+            nsunk++;
+    }
+    std::cout << nsunk << " of " << results.size() << " sank. " << simulated << " s simulated in " << elapsed << " s ("
+              << simulated / elapsed << "x real time)\n";
+
+    if (outfile.empty())
+        outfile = "sweep." + format;
+    std::ofstream out(outfile.c_str());
+    writeReport(out, results, format);
+    std::cout << "Wrote " << results.size() << " runs to " << outfile << "\n";
+    return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+namespace timer
+{
+    double now();   // wall-clock seconds since an arbitrary point, for measuring intervals
+}
+
+#endif // _TIMER_H_
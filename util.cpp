@@ -51,6 +51,17 @@ charbuffer getFileContents(std::string filename)
     return result;
 }
 
+std::vector<std::string> splitList(std::string list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
 template <typename T> std::string tostring(T x)
 {
     std::stringstream ss;
@@ -1,9 +1,9 @@
 #ifndef _UTIL_H_
 #define _UTIL_H
 
-#include <GL/gl.h>
 #include <json/json.h>
 #include <string>
+#include <vector>
 
 
 struct charbuffer
@@ -14,6 +14,7 @@ struct charbuffer
 
 Json::Value jsonParseFile(std::string filename);
 charbuffer getFileContents(std::string filename);
+std::vector<std::string> splitList(std::string list);     // "a,b,,c" => a, b, c
 template <typename T> std::string tostring(T x);
 
 #endif // _UTIL_H_